@@ -0,0 +1,450 @@
+#pragma once
+
+// コンピュータの思考. GameCore だけを見るので OpenGL がなくても動く
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "core.h"
+#include "evaluator.h"
+#include "movegen.h"
+#include "thread_pool.h"
+#include "transposition.h"
+
+
+// 探索の1ノード. ブロックの位置と, 書き換えない盤面への参照だけを持つ.
+// 置いた後の盤面は lock() が値で返すので, 本物のゲームには触らない
+struct SearchState
+{
+    const Bitboard *board;
+    Piece piece;
+
+    bool act(Action action)
+    {
+        return applyAction(*board, piece, action);
+    }
+
+    bool overlaps() const
+    {
+        return board->overlaps(piece.shape(), piece.x, piece.y);
+    }
+
+    // 今の位置でブロックを固定し, 揃った行を消した盤面
+    Bitboard lock(int *eliminatedRows = nullptr) const
+    {
+        Bitboard result = *board;
+        result.put(piece.shape(), piece.x, piece.y);
+        uint32_t cleared = result.clearLines();
+        if (eliminatedRows)
+            *eliminatedRows = __builtin_popcount(cleared);
+        return result;
+    }
+};
+
+// 先読みの設定
+struct SearchConfig
+{
+    int depth = 2;          /* 1: 今のブロックだけ, 2: 次のブロックまで, 3: その次をツモの残りで平均する */
+    int beamWidth = 8;      /* 深さごとに残す盤面の数 */
+    int pruneMargin = 300;  /* その深さの最善からこれより悪い盤面は先を読まない */
+    int nodeBudget = 20000; /* 1手で評価する置き方の上限. 超えたら読めたところまでで決める */
+    int timeBudgetUs = 0;   /* 1手にかける時間の上限 (マイクロ秒). 0 なら制限なし. 今のブロックの評価だけは必ず終える */
+};
+
+// 相手が今のブロックを固定したときに, こちらへ送ってくる行数の最大と, そのうち一番早く固定できる置き方までの tick 数.
+// 相手に溜まっている分は先に相殺される. 揃いそうな行 (4マス以内で埋まる行) が2行なければ攻撃はないので, 置き方を列挙しない.
+// generator は相手の置き方を並べるのに使うだけなので, 自分の探索のものとは別に持たせておく
+inline IncomingAttack estimateAttack(const OpponentSnapshot &opponent, PlacementGenerator &generator)
+{
+    IncomingAttack attack;
+    if (!opponent.valid)
+        return attack;
+    int nearlyFull = 0;
+    for (int y = 1; y <= opponent.board.maxHeight; y++)
+        nearlyFull += opponent.board.rowFill[y] >= 10 - 4;
+    if (nearlyFull < 2)
+        return attack;
+
+    int lines = 0, highest = 0; /* 一番多く消す置き方のうち, 一番高い (早く固定できる) 位置の y */
+    generator.generate(opponent.board, opponent.piece);
+    for (const Placement &placement : generator.placements())
+    {
+        Bitboard board = opponent.board;
+        board.put(placement.piece.shape(), placement.piece.x, placement.piece.y);
+        int cleared = __builtin_popcount(board.fullRows());
+        if (cleared > lines || (cleared == lines && placement.piece.y > highest))
+        {
+            lines = cleared;
+            highest = placement.piece.y;
+        }
+    }
+    attack.rows = std::max(0, attackForLines(lines) - opponent.pendingGarbage);
+    attack.ticks = opponent.piece.y - highest;
+    return attack;
+}
+
+class CpuPlayer
+{
+public:
+    CpuPlayer(const GameCore &game) : game(game) {}
+
+    // 計画した行動を1つ取り出す. 計画がなければ RL_ACTION_NONE
+    Action popAction()
+    {
+        if (registeredActions.size() == 0)
+            return RL_ACTION_NONE;
+        Action action = registeredActions.back();
+        registeredActions.pop_back();
+        return action;
+    }
+
+    void clearActions()
+    {
+        registeredActions.clear();
+    }
+
+    bool verbose = true;        /* 探索の結果を標準出力に出す */
+    ThreadPool *pool = nullptr; /* 置き方の評価を分けて走らせるプール. nullptr なら呼んだスレッドだけで評価する */
+    std::function<bool()> interrupt; /* true を返したら, 締め切りと同じく読めたところまでで探索を終える */
+    TranspositionTable *table = nullptr; /* 評価値を覚えておく置換表. 評価の重みが違う CpuPlayer とは共有しないこと */
+    EvalWeights weights = WEIGHTS_CLASSIC; /* 盤面の評価の重み. 探索の途中で変えないこと */
+    IncomingAttack expectedAttack; /* estimateAttack() の結果 */
+
+    SearchConfig config;
+
+    // 置ける位置をすべて評価して, 一番良い位置へ行く行動列を計画する.
+    // config.depth が2以上なら次のブロックも置いてみて, 先で一番良くなる位置を選ぶ
+    void stageTraversal()
+    {
+        int bestRoot = search();
+        int maxScore = bestRoot < 0 ? 0 : rootScores[bestRoot];
+        std::vector<Action> maxActions;
+        if (bestRoot >= 0)
+            generator.path(generator.placements()[bestRoot], maxActions);
+
+        if (verbose)
+            printActions(maxScore, maxActions);
+
+        registeredActions = maxActions;
+        std::reverse(registeredActions.begin(), registeredActions.end());
+    }
+
+    // stageTraversal() と同じように探して, 固定される位置だけを target に入れる. 置けなければ false.
+    // 行動列はブロックがそこまで動いた後で planTo() で作る
+    bool choosePlacement(Piece &target)
+    {
+        int bestRoot = search();
+        if (bestRoot < 0)
+            return false;
+        target = generator.placements()[bestRoot].piece;
+        return true;
+    }
+
+    // 今の位置から target と同じセルに固定されるまでの行動列を計画する. もう行けなければ今の計画のままで false
+    bool planTo(const Piece &target)
+    {
+        generator.generate(game.board, game.piece);
+        int key = cellKey(target);
+        for (const Placement &placement : generator.placements())
+        {
+            if (cellKey(placement.piece) != key)
+                continue;
+            generator.path(placement, registeredActions);
+            std::reverse(registeredActions.begin(), registeredActions.end());
+            return true;
+        }
+        return false;
+    }
+
+    // 直前の stageTraversal() で評価した置き方の数
+    int lastNodeCount() const
+    {
+        return nodeCount;
+    }
+
+    // 直前の探索が予算か締め切りで打ち切られたか
+    bool wasCutOff() const
+    {
+        return cutOff;
+    }
+
+    // 選んだ行動列を表示する
+    void printActions(int maxScore, const std::vector<Action> &actions)
+    {
+        std::cout << std::endl
+                  << "MAX SCORE: " << maxScore << std::endl;
+        for (Action cpuAction : actions)
+        {
+            switch (cpuAction)
+            {
+            case RL_ACTION_LEFT:
+                std::cout << "LEFT ";
+                break;
+            case RL_ACTION_RIGHT:
+                std::cout << "RIGHT ";
+                break;
+            case RL_ACTION_LEFT2:
+                std::cout << "LL ";
+                break;
+            case RL_ACTION_RIGHT2:
+                std::cout << "RR ";
+                break;
+            case RL_ACTION_ROTATE_RIGHT:
+                std::cout << "ROT ";
+                break;
+            case RL_ACTION_ROTATE_LEFT:
+                std::cout << "ROTL ";
+                break;
+            case RL_ACTION_NONE:
+                std::cout << "- ";
+                break;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    // これより少なければ, スレッドに配る手間の方が大きい (1つの評価は盤面の複製と数十命令)
+    static constexpr int PARALLEL_MIN_PLACEMENTS = 128;
+
+    // 先読みまでして一番良い根の置き方の番号 (generator.placements() の添字) を返す. 置けなければ -1
+    int search()
+    {
+        nodeCount = 0;
+        cutOff = false;
+        deadline = std::chrono::steady_clock::time_point::max();
+        if (config.timeBudgetUs > 0)
+            deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(config.timeBudgetUs);
+
+        // 1手目: 今のブロック. group は根の置き方の番号. 固定したときに来るお邪魔ブロックも入れて評価する
+        generator.generate(game.board, game.piece);
+        const std::vector<Placement> &placements = generator.placements();
+        leaves.clear();
+        for (int i = 0; i < (int)placements.size(); i++)
+            leaves.push_back({&game.board, placements[i].piece, i, game.pendingGarbage + arrivingRows(placements[i].piece)});
+        scoreLeaves(leaves, scores);
+        nodeCount += (int)leaves.size();
+        rootScores = scores;
+        selectBeam(false);
+
+        // 2手目: 次のブロックは分かっている
+        if (config.depth >= 2 && game.hasNext)
+            expandBeam(game.nextType);
+        // 3手目: その次はツモの残りのどれかなので, 種類ごとの最善の平均を取る
+        if (config.depth >= 3)
+            expectBeam();
+
+        // beam は良い順に並んでいる
+        return beam.empty() ? -1 : beam[0].root;
+    }
+
+    // 評価する置き方1つ. group はまとめる単位 (根の置き方, ビームの盤面など)
+    struct Leaf
+    {
+        const Bitboard *board;
+        Piece piece;
+        int group;
+        int incoming; /* 固定したときに来るお邪魔ブロックの行数 (相殺する前). 根の置き方だけ */
+    };
+
+    // 先読みで残しておく盤面
+    struct BeamNode
+    {
+        Bitboard board;
+        int root;    /* この盤面に行くための根の置き方 */
+        int score;
+        int carried; /* 根の置き方の後に相手から来そうな行数. 次のブロックを固定するときに入れる */
+    };
+
+    // 葉ごとに, 固定して行を消した盤面の評価値を scores に入れる.
+    // それぞれ独立なので, 数が多ければ pool で分けて計算する
+    void scoreLeaves(const std::vector<Leaf> &leaves, std::vector<int> &scores) const
+    {
+        scores.resize(leaves.size());
+        auto scoreRange = [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+            {
+                // 置いて行を消す前の盤面が同じなら評価値も同じなので, 盤面を作る前に置換表を引く.
+                // お邪魔ブロックが来る葉は来る行数にもよるので, 覚えない
+                const Piece &piece = leaves[i].piece;
+                bool cacheable = table && leaves[i].incoming == 0;
+                uint64_t key = 0;
+                if (cacheable)
+                {
+                    key = TT_SALT_PLACED ^ leaves[i].board->hash ^ Bitboard::placedHash(piece.shape(), piece.x, piece.y);
+                    if (table->probe(key, scores[i]))
+                        continue;
+                }
+                scores[i] = scoreLeaf(leaves[i]);
+                if (cacheable)
+                    table->store(key, scores[i]);
+            }
+        };
+
+        int count = (int)leaves.size();
+        if (pool && pool->size() > 1 && count >= PARALLEL_MIN_PLACEMENTS)
+            pool->parallelFor(count, scoreRange);
+        else
+            scoreRange(0, count);
+    }
+
+    // 相手から来そうな攻撃のうち, 根の置き方 piece で固定する前に来る行数. 後から来る分は次のブロックを固定するときに入れる.
+    // 次のブロックを読まないなら全部ここで入れる (でないと, 早く固定して攻撃をよける置き方が良く見えてしまう)
+    int arrivingRows(const Piece &piece) const
+    {
+        if (config.depth < 2 || !game.hasNext)
+            return expectedAttack.rows;
+        return expectedAttack.rowsBefore(game.piece.y - piece.y);
+    }
+
+    // 葉を固定して行を消し, 相殺しきれなかったお邪魔ブロックをせり上げた盤面
+    Bitboard lockLeaf(const Leaf &leaf) const
+    {
+        SearchState state{leaf.board, leaf.piece};
+        int lines;
+        Bitboard result = state.lock(&lines);
+        if (leaf.incoming > 0)
+            game.previewGarbage(result, lines, leaf.incoming);
+        return result;
+    }
+
+    // せり上がって次のブロックが出られなくなる葉は負け (SCORE_LOSS). 2手目より先は種類が分からないので, 次のブロックで代用する
+    int scoreLeaf(const Leaf &leaf) const
+    {
+        Bitboard board = lockLeaf(leaf);
+        if (leaf.incoming > 0 && game.hasNext)
+        {
+            Piece next = spawnPiece(game.nextType);
+            if (board.overlaps(next.shape(), next.x, next.y))
+                return SCORE_LOSS;
+        }
+        return evaluateBoard(board, weights);
+    }
+
+    // leaves のうち良いものから config.beamWidth 個を, 最善から pruneMargin 以内に限って次の beam にする.
+    // 別の順番で置いて同じ盤面になった葉は, 良い方 (同点なら前) だけを残す.
+    // 同点なら前にある葉を優先するので, スレッド数によらず同じ結果になる
+    void selectBeam(bool fromBeam)
+    {
+        order.resize(leaves.size());
+        for (int i = 0; i < (int)order.size(); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return scores[a] > scores[b]; });
+
+        nextBeam.clear();
+        for (int i : order)
+        {
+            if ((int)nextBeam.size() >= config.beamWidth || scores[i] < (long long)scores[order[0]] - config.pruneMargin)
+                break;
+            Bitboard board = lockLeaf(leaves[i]);
+            bool seen = false;
+            for (const BeamNode &node : nextBeam)
+                seen = seen || node.board.hash == board.hash;
+            if (seen)
+                continue;
+            int root = fromBeam ? beam[leaves[i].group].root : leaves[i].group;
+            int carried = fromBeam ? 0 : expectedAttack.rows - arrivingRows(leaves[i].piece);
+            nextBeam.push_back({board, root, scores[i], carried});
+        }
+        beam.swap(nextBeam);
+    }
+
+    // まだ評価を増やしてよいか. 予算か締め切りを過ぎたら cutOff を立て, それまでに読めた中で一番良いものを選ぶ
+    bool hasBudget()
+    {
+        if (nodeCount < config.nodeBudget && std::chrono::steady_clock::now() < deadline && !(interrupt && interrupt()))
+            return true;
+        cutOff = true;
+        return false;
+    }
+
+    // beam の盤面それぞれに type を置いてみて, 次の beam を作る.
+    // 評価の数が予算を超えたら, そこまでに広げた (良い方の) 盤面の子だけで決める
+    void expandBeam(int type)
+    {
+        leaves.clear();
+        for (int b = 0; b < (int)beam.size() && hasBudget(); b++)
+        {
+            Piece piece = spawnPiece(type);
+            lookahead.generate(beam[b].board, piece);
+            for (const Placement &placement : lookahead.placements())
+                leaves.push_back({&beam[b].board, placement.piece, b, beam[b].carried});
+            nodeCount += lookahead.placements().size();
+        }
+        // どこにも置けない (負け) か予算がないなら, 今の beam のまま
+        if (leaves.empty())
+            return;
+        scoreLeaves(leaves, scores);
+        selectBeam(true);
+    }
+
+    // beam の盤面それぞれの評価を, ツモの残りの種類ごとの最善の平均にして並べ直す
+    void expectBeam()
+    {
+        int types[PIECE_TYPES];
+        int typeCount = game.bag.upcoming(types);
+
+        // 盤面と種類の組ごとの最善. 置けない種類は負け (SCORE_LOSS) のまま残る
+        best.assign(beam.size() * PIECE_TYPES, SCORE_LOSS);
+        cached.assign(beam.size() * PIECE_TYPES, false);
+
+        leaves.clear();
+        int expanded = 0;
+        for (; expanded < (int)beam.size() && hasBudget(); expanded++)
+        {
+            for (int t = 0; t < typeCount; t++)
+            {
+                int group = expanded * PIECE_TYPES + t;
+                uint64_t key = TT_SALT_BEST[types[t]] ^ beam[expanded].board.hash;
+                if (table && table->probe(key, best[group]))
+                {
+                    cached[group] = true;
+                    continue;
+                }
+                lookahead.generate(beam[expanded].board, spawnPiece(types[t]));
+                for (const Placement &placement : lookahead.placements())
+                    leaves.push_back({&beam[expanded].board, placement.piece, group, 0});
+                nodeCount += lookahead.placements().size();
+            }
+        }
+        if (expanded == 0)
+            return;
+        scoreLeaves(leaves, scores);
+
+        for (size_t i = 0; i < leaves.size(); i++)
+            best[leaves[i].group] = std::max(best[leaves[i].group], scores[i]);
+        beam.resize(expanded);
+        for (int b = 0; b < expanded; b++)
+        {
+            long long sum = 0; /* SCORE_LOSS を足すので int では溢れる */
+            for (int t = 0; t < typeCount; t++)
+            {
+                int group = b * PIECE_TYPES + t;
+                if (table && !cached[group])
+                    table->store(TT_SALT_BEST[types[t]] ^ beam[b].board.hash, best[group]);
+                sum += best[group];
+            }
+            beam[b].score = (int)(sum / typeCount);
+        }
+        std::stable_sort(beam.begin(), beam.end(), [](const BeamNode &a, const BeamNode &b) { return a.score > b.score; });
+    }
+
+    const GameCore &game;
+    std::vector<Action> registeredActions;
+    PlacementGenerator generator; /* 今のブロック. 選んだ置き方の行動列はここから作る */
+    PlacementGenerator lookahead; /* 先読みのブロック */
+    std::vector<Leaf> leaves;
+    std::vector<int> scores;
+    std::vector<int> rootScores;
+    std::vector<int> order;
+    std::vector<BeamNode> beam;
+    std::vector<BeamNode> nextBeam;
+    std::vector<int> best;
+    std::vector<char> cached;
+    int nodeCount = 0;
+    bool cutOff = false; /* 直前の探索が予算か締め切りで途中までになった */
+    std::chrono::steady_clock::time_point deadline;
+};
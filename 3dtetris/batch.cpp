@@ -0,0 +1,92 @@
+// コンピュータ同士の対戦をウィンドウなしでまとめて走らせる
+//   ./batch [試合数] [最初の種] [スレッド数] [1試合の最大ツモ数] [リプレイを書き出すディレクトリ ("" なら書かない)] [P1 の思考 (beam か mcts)]
+// 試合 i は種 (最初の種 + i) で進むので, 同じ引数なら同じ結果になる.
+// P1 を mcts にすると, 試合ごとに1スレッドのモンテカルロ木探索 (試し打ちの回数で打ち切る) がビームサーチの P0 と戦う
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "match.h"
+#include "thread_pool.h"
+
+int main(int argc, char **argv)
+{
+    int matchCount = argc > 1 ? atoi(argv[1]) : 100;
+    uint32_t baseSeed = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 1;
+    int threadCount = argc > 3 ? atoi(argv[3]) : 0;
+    int maxPieces = argc > 4 ? atoi(argv[4]) : 1000;
+    std::string replayDir = argc > 5 ? argv[5] : "";
+    std::string player1 = argc > 6 ? argv[6] : "beam";
+    if (player1 != "beam" && player1 != "mcts")
+    {
+        fprintf(stderr, "unknown player %s (beam or mcts)\n", player1.c_str());
+        return 1;
+    }
+
+    std::vector<MatchResult> results(matchCount);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threadCount);
+        threadCount = pool.size();
+        for (int i = 0; i < matchCount; i++)
+        {
+            pool.submit([&results, &replayDir, &player1, i, baseSeed, maxPieces] {
+                Match match(baseSeed + i);
+                if (player1 == "mcts")
+                    match.setMcts(1, MctsConfig());
+                if (replayDir.empty())
+                {
+                    results[i] = match.play(maxPieces);
+                    return;
+                }
+
+                ReplayWriter recorder(baseSeed + i);
+                match.record(&recorder);
+                results[i] = match.play(maxPieces);
+                std::string path = replayDir + "/match_" + std::to_string(baseSeed + i) + ".rep";
+                if (!recorder.save(path))
+                    fprintf(stderr, "failed to write %s\n", path.c_str());
+            });
+        }
+        pool.wait();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int wins[2] = {0, 0};
+    int draws = 0;
+    long long pieces = 0, lines = 0, attacks = 0, ticks = 0;
+    for (const MatchResult &result : results)
+    {
+        if (result.winner < 0)
+            draws++;
+        else
+            wins[result.winner]++;
+        for (int i = 0; i < 2; i++)
+        {
+            pieces += result.pieces[i];
+            lines += result.lines[i];
+            attacks += result.attacks[i];
+        }
+        ticks += result.ticks;
+    }
+
+    printf("matches      %d (seeds %u..%u, %d threads)\n", matchCount, baseSeed, baseSeed + matchCount - 1, threadCount);
+    printf("players      P0 beam / P1 %s\n", player1.c_str());
+    printf("time         %.3f s\n", seconds);
+    printf("matches/sec  %.2f\n", matchCount / seconds);
+    printf("pieces/sec   %.1f\n", pieces / seconds);
+    printf("wins         P0 %d / P1 %d / draw %d\n", wins[0], wins[1], draws);
+    if (matchCount > 0)
+    {
+        printf("avg pieces   %.1f per match\n", (double)pieces / matchCount);
+        printf("avg lines    %.1f per match\n", (double)lines / matchCount);
+        printf("avg attacks  %.1f rows per match\n", (double)attacks / matchCount);
+        printf("avg ticks    %.1f per match\n", (double)ticks / matchCount);
+    }
+
+    return 0;
+}
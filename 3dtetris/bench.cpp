@@ -0,0 +1,244 @@
+// 置き方の探索のベンチマーク
+//   ./bench [1局面あたりの繰り返し数] [評価に使うスレッド数 (0 なら呼んだスレッドだけ)]
+// 決まった局面 (空から山積み・詰み寸前まで. 真下に落とすだけでは入れない T の穴・屋根の下の隙間も含む) のそれぞれに7種類のブロックを出して,
+//   1. 置ける位置の数を数える (perft). 1手目と, 次のブロックまで置いた2手目の数を, 覚えておいた値と比べる.
+//      数えるのは埋まるセルが違う固定位置で, O を回しただけのように同じセルを埋める向き違いは1つと数える (空の盤面で O は 9, I・S・Z は 17)
+//   2. PlacementGenerator だけを回して, たどった状態の数と置き方の数を1秒あたりで出す
+//   3. CpuPlayer の1手の判断 (choosePlacement) にかかる時間の分布を出す
+// 置ける位置の数が覚えておいた値と違えば 1 で終わる. 探索を速くしたら, 数が変わらないことと速さをここで確かめる
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ai.h"
+
+// 局面. 上の行から順に '#' が埋まっているセル. 書いていない上の方は空
+struct Position
+{
+    const char *name;
+    std::vector<const char *> rows;
+    long long perft1; /* 7種類の置き方 (埋まるセルが違う固定位置) の数の合計 */
+    long long perft2; /* 置いた後に次のブロック (種類 + 1) を置く置き方の数の合計 */
+};
+
+static const Position POSITIONS[] = {
+    {"empty", {}, 162, 3568},
+    // 右から滑り込ませて回す T の穴 (Tスピンダブル). 屋根 (左上) の下は落とすだけでは入れない
+    {"tslot",
+     {
+         "####......",
+         "###...####",
+         "####.#####",
+     },
+     166, 3696},
+    // 屋根の下に横から差し込む隙間. どの種類にも, 落としてから横にずらして潜る置き方がある
+    {"tuck",
+     {
+         "......####",
+         "#........#",
+         "##.......#",
+         "########.#",
+     },
+     189, 4679},
+    {"overhang",
+     {
+         "##....####",
+         "#......###",
+         "#..#....##",
+         "##.##.#..#",
+         "####..##.#",
+         "#####.####",
+     },
+     192, 4822},
+    // 屋根の下の2段のトンネル. 寝かせた I を横から奥まで入れられる
+    {"cave",
+     {
+         "....######",
+         "##........",
+         "##........",
+         "########.#",
+     },
+     183, 4385},
+    {"garbage",
+     {
+         "..##...#..",
+         "#.###..##.",
+         "#########.",
+         "###.######",
+         "######.###",
+         ".#########",
+         "#####.####",
+         "########.#",
+         "##.#######",
+         "####.#####",
+         "#######.##",
+     },
+     162, 3565},
+    {"topout",
+     {
+         "###....###",
+         "###....###",
+         "####..####",
+         "####.#####",
+         "#.########",
+         "####.#####",
+         "##.#######",
+         "#########.",
+         "#.########",
+         "###.######",
+         "######.###",
+         "##.#######",
+         ".#########",
+         "#####.####",
+         "#######.##",
+         "###.######",
+     },
+     138, 2202},
+};
+
+// 局面を盤面にする. 1セルずつ置くので, 高さや穴などの特徴量も普通に置いたときと同じになる
+static Board makeBoard(const Position &position)
+{
+    PieceShape cell;
+    cell.height = 1;
+    cell.rows[0] = 1;
+
+    Board board;
+    int height = (int)position.rows.size();
+    for (int i = 0; i < height; i++)
+    {
+        for (int x = 1; x <= 10; x++)
+        {
+            if (position.rows[i][x - 1] == '#')
+                board.put(cell, x, height - i, COLOR_GARBAGE);
+        }
+    }
+    return board;
+}
+
+// board に type を置ける位置の数. depth が2以上なら, 置いた後の盤面に次の種類を置ける位置の数を足し合わせる
+static long long perft(PlacementGenerator *generators, const Bitboard &board, int type, int depth)
+{
+    PlacementGenerator &generator = generators[0];
+    int count = generator.generate(board, spawnPiece(type));
+    if (depth <= 1)
+        return count;
+
+    long long total = 0;
+    for (const Placement &placement : generator.placements())
+    {
+        Bitboard next = board;
+        next.put(placement.piece.shape(), placement.piece.x, placement.piece.y);
+        next.clearLines();
+        total += perft(generators + 1, next, (type + 1) % PIECE_TYPES, depth - 1);
+    }
+    return total;
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+    int threadCount = argc > 2 ? atoi(argv[2]) : 0;
+
+    // 1. 置ける位置の数
+    bool mismatch = false;
+    PlacementGenerator generators[2];
+    printf("perft (placements for each type, then the total 1 ply / 2 ply)\n");
+    for (const Position &position : POSITIONS)
+    {
+        Board board = makeBoard(position);
+        long long perft1 = 0, perft2 = 0;
+        printf("  %-9s", position.name);
+        for (int type = 0; type < PIECE_TYPES; type++)
+        {
+            long long count = perft(generators, board, type, 1);
+            printf(" %3lld", count);
+            perft1 += count;
+            perft2 += perft(generators, board, type, 2);
+        }
+        bool ok = perft1 == position.perft1 && perft2 == position.perft2;
+        mismatch |= !ok;
+        printf("  | %4lld %7lld  %s\n", perft1, perft2, ok ? "ok" : "MISMATCH");
+        if (!ok)
+            printf("            expected %4lld %7lld\n", position.perft1, position.perft2);
+    }
+
+    // 2. 置き方の列挙だけの速さ
+    long long nodes = 0, placements = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Position &position : POSITIONS)
+    {
+        Board board = makeBoard(position);
+        for (int r = 0; r < repeats * 10; r++)
+        {
+            for (int type = 0; type < PIECE_TYPES; type++)
+            {
+                placements += generators[0].generate(board, spawnPiece(type));
+                nodes += generators[0].nodeCount();
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("movegen: %lld nodes, %lld placements in %.3f s (%.0f nodes/sec, %.0f placements/sec)\n",
+           nodes, placements, seconds, nodes / seconds, placements / seconds);
+
+    // 3. 1手の判断. 置換表は使わない (同じ局面を繰り返すので, 使うと2回目から測れない)
+    ThreadPool *pool = threadCount > 0 ? new ThreadPool(threadCount) : nullptr;
+    GameCore game;
+    game.seed(1);
+    game.reset();
+    CpuPlayer cpu(game);
+    cpu.verbose = false;
+    cpu.pool = pool;
+
+    printf("decision (depth %d, beam %d, %d threads)\n", cpu.config.depth, cpu.config.beamWidth, pool ? pool->size() : 1);
+    printf("  %-9s %8s %8s %8s %8s %8s %12s\n", "position", "evals", "p50 us", "p90 us", "p99 us", "max us", "evals/sec");
+    std::vector<double> all;
+    long long allEvaluated = 0;
+    for (const Position &position : POSITIONS)
+    {
+        game.board = makeBoard(position);
+        std::vector<double> latencies;
+        long long evaluated = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            for (int type = 0; type < PIECE_TYPES; type++)
+            {
+                game.piece = spawnPiece(type);
+                game.nextType = (type + 1) % PIECE_TYPES;
+                Piece target;
+                auto begin = std::chrono::steady_clock::now();
+                cpu.choosePlacement(target);
+                latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+                evaluated += cpu.lastNodeCount();
+            }
+        }
+        double total = 0;
+        for (double latency : latencies)
+            total += latency;
+        all.insert(all.end(), latencies.begin(), latencies.end());
+        allEvaluated += evaluated;
+
+        std::sort(latencies.begin(), latencies.end());
+        printf("  %-9s %8lld %8.0f %8.0f %8.0f %8.0f %12.0f\n", position.name, evaluated / (long long)latencies.size(),
+               percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99), latencies.back(),
+               evaluated / (total * 1e-6));
+    }
+    double total = 0;
+    for (double latency : all)
+        total += latency;
+    std::sort(all.begin(), all.end());
+    printf("  %-9s %8lld %8.0f %8.0f %8.0f %8.0f %12.0f\n", "all", allEvaluated / (long long)all.size(),
+           percentile(all, 0.5), percentile(all, 0.9), percentile(all, 0.99), all.back(), allEvaluated / (total * 1e-6));
+    delete pool;
+
+    return mismatch ? 1 : 0;
+}
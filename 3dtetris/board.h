@@ -0,0 +1,398 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "random.h"
+
+// 盤面の大きさ (壁を含む). x=0, x=11 が左右の壁, y=0 が床
+constexpr int STAGE_WIDTH = 12;
+constexpr int STAGE_HEIGHT = 21;
+
+constexpr uint16_t FULL_ROW = 0x0FFF;  /* 12列すべて埋まっている */
+constexpr uint16_t WALL_ROW = 0x0801;  /* 左右の壁だけ */
+constexpr uint16_t INNER_ROW = 0x07FE; /* 壁の内側 x=1..10 */
+
+constexpr int8_t COLOR_EMPTY = -1;
+constexpr int8_t COLOR_GARBAGE = 7;
+constexpr int8_t COLOR_WALL = 10;
+
+// ブロックの形を行ごとのビットマスクにしたもの.
+// rows[i] は y = 基準点 + minY + i の行で, bit0 が x = 基準点 + minX の列
+struct PieceShape
+{
+    int minX = 0;
+    int minY = 0;
+    int height = 0;
+    uint16_t rows[4] = {0, 0, 0, 0};
+};
+
+// 盤面の Zobrist ハッシュの乱数. 内側のセル (x, y) ごとに1つ持ち, 埋まっているセルの乱数の XOR を盤面のハッシュにする.
+// 1行をまとめて引けるよう, 内側の10列を5列ずつに分けた全パターンの XOR もコンパイル時に作っておく
+constexpr int ZOBRIST_CHUNK_BITS = 5;
+
+struct ZobristTables
+{
+    uint64_t cells[STAGE_HEIGHT][STAGE_WIDTH];
+    uint64_t chunks[STAGE_HEIGHT][2][1 << ZOBRIST_CHUNK_BITS];
+};
+
+constexpr ZobristTables makeZobristTables()
+{
+    ZobristTables tables{};
+    uint64_t state = 0x3D7E7215ull;
+    for (int y = 1; y < STAGE_HEIGHT; y++)
+        for (int x = 1; x <= 10; x++)
+            tables.cells[y][x] = Rng::splitmix64(state);
+
+    for (int y = 1; y < STAGE_HEIGHT; y++)
+    {
+        for (int chunk = 0; chunk < 2; chunk++)
+        {
+            for (int bits = 0; bits < (1 << ZOBRIST_CHUNK_BITS); bits++)
+            {
+                uint64_t hash = 0;
+                for (int i = 0; i < ZOBRIST_CHUNK_BITS; i++)
+                {
+                    if ((bits >> i) & 1)
+                        hash ^= tables.cells[y][1 + chunk * ZOBRIST_CHUNK_BITS + i];
+                }
+                tables.chunks[y][chunk][bits] = hash;
+            }
+        }
+    }
+    return tables;
+}
+
+constexpr ZobristTables ZOBRIST = makeZobristTables();
+
+// 1行を uint16_t のビットマスクで持つ盤面 (埋まっているかだけ). 衝突判定はマスクの AND だけで済む.
+// 列の高さ・穴の数・行の埋まり具合・凸凹・ハッシュは固定・行消し・せり上げのたびに差分で更新しておくので,
+// 評価関数は盤面を走査せずに読める. それでも100バイトに満たないので, 探索ではこれを値で複製して使う
+struct Bitboard
+{
+    Bitboard() { reset(); }
+
+    void reset()
+    {
+        rows[0] = FULL_ROW; /*床*/
+        for (int y = 1; y < STAGE_HEIGHT; y++)
+            rows[y] = WALL_ROW;
+
+        heights.fill(0);
+        rowFill.fill(0);
+        holes = 0;
+        hash = 0;
+        updateSurface();
+    }
+
+    // 行 y が mask のときのハッシュへの寄与. 壁のビットは見ない.
+    // セルの乱数の XOR なので, 行の一部のマスクを渡せばそのセルだけの寄与になる
+    static uint64_t rowHash(int y, uint16_t mask)
+    {
+        return ZOBRIST.chunks[y][0][(mask >> 1) & 31] ^ ZOBRIST.chunks[y][1][(mask >> 6) & 31];
+    }
+
+    // shape を (x, y) に置いたときに増えるセルの寄与. hash ^ placedHash() が, 置いて行を消す前の盤面のハッシュになる
+    static uint64_t placedHash(const PieceShape &shape, int x, int y)
+    {
+        uint64_t result = 0;
+        for (int i = 0; i < shape.height; i++)
+            result ^= rowHash(y + shape.minY + i, shape.rows[i] << (x + shape.minX));
+        return result;
+    }
+
+    bool isFilled(int x, int y) const
+    {
+        return (rows[y] >> x) & 1;
+    }
+
+    // (x, y) に shape を置いたとき, 壁やブロックと重なるか. 盤面の外も重なり扱い
+    bool overlaps(const PieceShape &shape, int x, int y) const
+    {
+        int left = x + shape.minX;
+        int bottom = y + shape.minY;
+        if (left < 0 || bottom < 0 || bottom + shape.height > STAGE_HEIGHT)
+            return true;
+
+        for (int i = 0; i < shape.height; i++)
+        {
+            uint32_t mask = (uint32_t)shape.rows[i] << left;
+            if (mask & ((uint32_t)rows[bottom + i] | ~(uint32_t)FULL_ROW))
+                return true;
+        }
+        return false;
+    }
+
+    // shape を (x, y) に固定する. 重ならないことは呼び出し側で確認しておくこと
+    void put(const PieceShape &shape, int x, int y)
+    {
+        int left = x + shape.minX;
+        int bottom = y + shape.minY;
+
+        // 列ごとに, 今の高さより上に置いたセルの数と一番上のセル
+        int above[STAGE_WIDTH] = {0};
+        int top[STAGE_WIDTH] = {0};
+        for (int i = 0; i < shape.height; i++)
+        {
+            int cy = bottom + i;
+            uint16_t mask = shape.rows[i] << left;
+            rows[cy] |= mask;
+            rowFill[cy] += __builtin_popcount(mask);
+            hash ^= rowHash(cy, mask);
+            while (mask)
+            {
+                int cx = __builtin_ctz(mask);
+                mask &= mask - 1;
+                if (cy < heights[cx])
+                    holes--; /* 横から穴に差し込んだ */
+                else
+                    above[cx]++;
+                if (cy > top[cx])
+                    top[cx] = cy;
+            }
+        }
+
+        // 高さが伸びた列は, 元の高さとの間で埋めなかったセルが穴になる
+        for (int cx = 1; cx <= 10; cx++)
+        {
+            if (top[cx] > heights[cx])
+            {
+                holes += top[cx] - heights[cx] - above[cx];
+                heights[cx] = top[cx];
+            }
+        }
+        updateSurface();
+    }
+
+    // 揃っている行の集合 (bit y が行 y). 行マスクを1回なめるだけで, 分岐しない
+    uint32_t fullRows() const
+    {
+        uint32_t full = 0;
+        for (int y = 1; y < STAGE_HEIGHT; y++)
+            full |= (uint32_t)(rows[y] == FULL_ROW) << y;
+        return full;
+    }
+
+    // 揃った行を消して上を1回の走査で詰める. 消した行の集合 (bit y が消す前の行 y) を返す.
+    // 消した行数は __builtin_popcount で分かる
+    uint32_t clearLines()
+    {
+        uint32_t cleared = fullRows();
+        if (cleared == 0)
+            return 0;
+
+        // 一番下の消える行より上は位置が変わるので, ハッシュは詰める前と後の分を入れ替える
+        int lowest = __builtin_ctz(cleared);
+        int top = maxHeight;
+        hash ^= rowsHash(lowest, top);
+
+        // 残す行は書き込み先を1つ進め, 消す行は同じ場所に次の行を上書きさせる
+        int dst = 1;
+        for (int y = 1; y < STAGE_HEIGHT; y++)
+        {
+            rows[dst] = rows[y];
+            rowFill[dst] = rowFill[y];
+            dst += !((cleared >> y) & 1);
+        }
+        for (; dst < STAGE_HEIGHT; dst++)
+        {
+            rows[dst] = WALL_ROW;
+            rowFill[dst] = 0;
+        }
+        hash ^= rowsHash(lowest, top);
+
+        int eliminatedRows = __builtin_popcount(cleared);
+        // 揃った行はどの列でも高さ以下にあるので, 高さは消した行数だけ下がる.
+        // 一番上のブロックが消えた列は, その下にあった穴が表に出るので下まで見直す
+        for (int cx = 1; cx <= 10; cx++)
+        {
+            int h = heights[cx] - eliminatedRows;
+            int newTop = h;
+            while (newTop > 0 && !isFilled(cx, newTop))
+                newTop--;
+            holes -= h - newTop;
+            heights[cx] = newTop;
+        }
+        updateSurface();
+        return cleared;
+    }
+
+    // 盤面を level 行せり上げ, 下から space 列だけ空いたお邪魔ブロックの行を入れる
+    void raise(int level, const int *spaces)
+    {
+        if (level <= 0)
+            return;
+        if (level >= STAGE_HEIGHT - 1)
+            level = STAGE_HEIGHT - 1;
+
+        // 上からはみ出す列は, 今の穴を引いておいて後で数え直す
+        for (int cx = 1; cx <= 10; cx++)
+        {
+            if (heights[cx] + level >= STAGE_HEIGHT)
+                holes -= columnHoles(cx);
+        }
+
+        for (int y = STAGE_HEIGHT - 1; y > level; y--)
+        {
+            rows[y] = rows[y - level];
+            rowFill[y] = rowFill[y - level];
+        }
+        for (int y = 1; y <= level; y++)
+        {
+            rows[y] = FULL_ROW & ~(uint16_t)(1u << spaces[y - 1]);
+            rowFill[y] = 9;
+        }
+
+        for (int cx = 1; cx <= 10; cx++)
+        {
+            if (heights[cx] > 0 && heights[cx] + level < STAGE_HEIGHT)
+            {
+                // 元の山の下に入ったお邪魔ブロックの空きはすべて穴になる
+                heights[cx] += level;
+                for (int y = 0; y < level; y++)
+                    holes += (spaces[y] == cx);
+            }
+            else
+            {
+                // 空だった列と, 上からはみ出した列は数え直す
+                int top = STAGE_HEIGHT - 1;
+                while (top > 0 && !isFilled(cx, top))
+                    top--;
+                heights[cx] = top;
+                holes += columnHoles(cx);
+            }
+        }
+        updateSurface();
+
+        // すべての行が動いたので作り直す
+        hash = rowsHash(1, maxHeight);
+    }
+
+    std::array<uint16_t, STAGE_HEIGHT> rows;
+
+    std::array<uint8_t, STAGE_WIDTH> heights;  /* 列ごとの一番上のブロックの高さ. 壁の列は0 */
+    std::array<uint8_t, STAGE_HEIGHT> rowFill; /* 行ごとの埋まっているセルの数 (壁を除く) */
+    int16_t holes;                             /* 上を塞がれた空きセルの数 */
+    int16_t heightSum;                         /* 高さの合計 */
+    int16_t bumpiness;                         /* 隣との高さの差の合計 (左の壁の高さは0とする) */
+    uint8_t maxHeight;                         /* 一番高い列の高さ */
+    uint64_t hash;                             /* 埋まっている内側のセルの Zobrist ハッシュ */
+
+private:
+    // 列ごとの高さから, 合計・凸凹・最大を作り直す (10列だけ)
+    void updateSurface()
+    {
+        heightSum = 0;
+        bumpiness = 0;
+        maxHeight = 0;
+        int neighbor = 0;
+        for (int cx = 1; cx <= 10; cx++)
+        {
+            int h = heights[cx];
+            heightSum += h;
+            bumpiness += h > neighbor ? h - neighbor : neighbor - h;
+            maxHeight = h > maxHeight ? h : maxHeight;
+            neighbor = h;
+        }
+    }
+
+    // 行 from..to のハッシュへの寄与
+    uint64_t rowsHash(int from, int to) const
+    {
+        uint64_t result = 0;
+        for (int y = from; y <= to; y++)
+            result ^= rowHash(y, rows[y]);
+        return result;
+    }
+
+    // 列 cx の, 高さより下にある空きセルの数
+    int columnHoles(int cx) const
+    {
+        int count = 0;
+        for (int y = 1; y < heights[cx]; y++)
+            count += !isFilled(cx, y);
+        return count;
+    }
+};
+
+// 描画用の色 (colors) も一緒に持つ盤面. ゲーム本体はこちらを使う
+class Board : public Bitboard
+{
+public:
+    Board() { reset(); }
+
+    void reset()
+    {
+        Bitboard::reset();
+        for (int y = 0; y < STAGE_HEIGHT; y++)
+        {
+            for (int x = 0; x < STAGE_WIDTH; x++)
+            {
+                bool wall = (y == 0 || x == 0 || x == STAGE_WIDTH - 1);
+                colors[y][x] = wall ? COLOR_WALL : COLOR_EMPTY;
+            }
+        }
+    }
+
+    void put(const PieceShape &shape, int x, int y, int8_t color)
+    {
+        Bitboard::put(shape, x, y);
+        int left = x + shape.minX;
+        int bottom = y + shape.minY;
+        for (int i = 0; i < shape.height; i++)
+        {
+            uint16_t mask = shape.rows[i] << left;
+            for (int cx = 0; cx < STAGE_WIDTH; cx++)
+            {
+                if ((mask >> cx) & 1)
+                    colors[bottom + i][cx] = color;
+            }
+        }
+    }
+
+    uint32_t clearLines()
+    {
+        // 色を先に同じやり方で詰めてから, マスクと特徴量を Bitboard 側で詰める
+        uint32_t cleared = fullRows();
+        if (cleared == 0)
+            return 0;
+        int dst = 1;
+        for (int y = 1; y < STAGE_HEIGHT; y++)
+        {
+            colors[dst] = colors[y];
+            dst += !((cleared >> y) & 1);
+        }
+        for (; dst < STAGE_HEIGHT; dst++)
+            clearColorRow(dst);
+        return Bitboard::clearLines();
+    }
+
+    void raise(int level, const int *spaces)
+    {
+        for (int y = STAGE_HEIGHT - 1; y >= 1; y--)
+        {
+            if (y - level <= 0)
+                continue;
+            colors[y] = colors[y - level];
+        }
+
+        for (int y = 1; y < 1 + level && y < STAGE_HEIGHT; y++)
+        {
+            int space = spaces[y - 1];
+            for (int x = 1; x <= 10; x++)
+                colors[y][x] = (x == space) ? COLOR_EMPTY : COLOR_GARBAGE;
+        }
+        Bitboard::raise(level, spaces);
+    }
+
+    std::array<std::array<int8_t, STAGE_WIDTH>, STAGE_HEIGHT> colors;
+
+private:
+    void clearColorRow(int y)
+    {
+        colors[y].fill(COLOR_EMPTY);
+        colors[y][0] = COLOR_WALL;
+        colors[y][STAGE_WIDTH - 1] = COLOR_WALL;
+    }
+};
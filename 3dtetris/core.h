@@ -0,0 +1,372 @@
+#pragma once
+
+// OpenGL を使わないゲーム本体. 盤面・ブロック・ルール・お邪魔ブロック・ツモの生成だけを持ち,
+// 描画は game.h の Game がこれを覗いて行う. ウィンドウを開かないプロセスでも動かせる
+
+#include <algorithm>
+#include <cstdint>
+
+#include "board.h"
+#include "piece.h"
+#include "random.h"
+
+enum Action
+{
+    RL_ACTION_NONE,
+    RL_ACTION_RIGHT,
+    RL_ACTION_LEFT,
+    RL_ACTION_RIGHT2,
+    RL_ACTION_LEFT2,
+    RL_ACTION_ROTATE_RIGHT,
+    RL_ACTION_ROTATE_LEFT,
+};
+
+constexpr int SPAWN_X = 6;
+constexpr int SPAWN_Y = 19;
+
+// 落下中のブロック
+struct Piece
+{
+    int type = 0;
+    int x = SPAWN_X;
+    int y = SPAWN_Y;
+    int rotnum = 0; /* 0, 1, 2, 3 */
+
+    const PieceShape &shape() const
+    {
+        return pieceShape(type, rotnum);
+    }
+};
+
+// 出現位置の type のブロック
+inline Piece spawnPiece(int type)
+{
+    Piece piece;
+    piece.type = type;
+    return piece;
+}
+
+// ブロックの位置 (x, y, 回転) を詰めた整数. 探索の重複判定で平らな配列やビット集合の添字に使う.
+// 盤面と重ならない位置は必ず 0..POSE_KEY_COUNT-1 に入る (どのブロックも中心 (0, 0) を含むので x = 0..11, y = 0..20)
+constexpr int POSE_KEY_COUNT = 4 * STAGE_HEIGHT * STAGE_WIDTH;
+
+inline int poseKey(const Piece &piece)
+{
+    return (piece.rotnum * STAGE_HEIGHT + piece.y) * STAGE_WIDTH + piece.x;
+}
+
+// 固定したときに埋まるセルで決まる整数. 向きが違っても同じセルを埋める位置 (O の全向き, I・S・Z の 0 と 2 など) は同じ値になる.
+// 同じ形の一番小さい向きに直し, 形の左下が同じ場所に来るよう中心をずらして poseKey() にする. 直した中心も埋まるセルなので範囲に入る
+inline int cellKey(const Piece &piece)
+{
+    const PieceShape &shape = piece.shape();
+    Piece same = piece;
+    same.rotnum = pieceSameCells(piece.type, piece.rotnum);
+    const PieceShape &sameShape = same.shape();
+    same.x += shape.minX - sameShape.minX;
+    same.y += shape.minY - sameShape.minY;
+    return poseKey(same);
+}
+
+// 7種1巡のツモ. 残りを固定長の配列に持ち, ヒープを使わない
+class Bag
+{
+public:
+    int next(Rng &rng)
+    {
+        // 方式1: 完全ランダム
+        // return rng.nextInt(0,6);
+
+        // 方式2:
+        if (remaining == 0) {
+            for (int i = 0; i <= 6; ++i) {
+                nextStore[i] = i;
+            }
+            remaining = 7;
+        }
+        int randidx = rng.nextInt(0, remaining-1);
+        int result = nextStore[randidx];
+        nextStore[randidx] = nextStore[--remaining];
+        return result;
+    }
+
+    void reset()
+    {
+        remaining = 0;
+    }
+
+    // 今の巡でまだ出ていない種類を types に入れて, その数を返す. 巡の終わりなら7種すべて
+    int upcoming(int types[7]) const
+    {
+        if (remaining == 0)
+        {
+            for (int i = 0; i <= 6; ++i)
+                types[i] = i;
+            return 7;
+        }
+        for (int i = 0; i < remaining; ++i)
+            types[i] = nextStore[i];
+        return remaining;
+    }
+
+private:
+    int8_t nextStore[7];
+    int remaining = 0;
+};
+
+// Super Rotation System. ちょっとずらしてみて入るならokとする
+// ずらし量は piece.h の表を引く. どこにも入らなければ回さずに true を返す
+inline bool rotateWithKicks(const Bitboard &board, Piece &piece, int dir)
+{
+    int to = (piece.rotnum + (dir > 0 ? 1 : 3)) % 4;
+    const PieceShape &shape = pieceShape(piece.type, to);
+    const Cell *kicks = srsKicks(piece.type, piece.rotnum, dir);
+    for (int i = 0; i < srsKickCount(piece.type); i++)
+    {
+        if (!board.overlaps(shape, piece.x + kicks[i].x, piece.y + kicks[i].y))
+        {
+            piece.x += kicks[i].x;
+            piece.y += kicks[i].y;
+            piece.rotnum = to;
+            return false;
+        }
+    }
+    return true;
+}
+
+// board の上で piece を動かす. 壁やブロックにめり込むなど、行動を巻き戻す必要があった場合はtrueを返す.
+inline bool applyAction(const Bitboard &board, Piece &piece, Action action)
+{
+    bool error = false;
+
+    switch (action)
+    {
+    case RL_ACTION_RIGHT:
+    {
+        piece.x++;
+        if (board.overlaps(piece.shape(), piece.x, piece.y))
+        {
+            error = true;
+            piece.x--;
+        }
+    }
+    break;
+    case RL_ACTION_LEFT:
+    {
+        piece.x--;
+        if (board.overlaps(piece.shape(), piece.x, piece.y))
+        {
+            error = true;
+            piece.x++;
+        }
+    }
+    break;
+    /*コンピュータ用　プレイヤーもキーを２回叩けばできるので、不公平ではない*/
+    case RL_ACTION_RIGHT2:
+    {
+        applyAction(board, piece, RL_ACTION_RIGHT);
+        applyAction(board, piece, RL_ACTION_RIGHT);
+    }
+    break;
+    case RL_ACTION_LEFT2:
+    {
+        applyAction(board, piece, RL_ACTION_LEFT);
+        applyAction(board, piece, RL_ACTION_LEFT);
+    }break;
+    case RL_ACTION_ROTATE_RIGHT:
+    {
+        error = rotateWithKicks(board, piece, 1);
+    }
+    break;
+    case RL_ACTION_ROTATE_LEFT:
+    {
+        error = rotateWithKicks(board, piece, -1);
+    }
+    break;
+    default:
+        break;
+    }
+
+    return error;
+}
+
+// lines 行を一度に消したときに相手へ送るお邪魔ブロックの行数 (相殺する前). 2行以上で (行数 - 1) 行
+inline int attackForLines(int lines)
+{
+    return lines >= 2 ? lines - 1 : 0;
+}
+
+// お邪魔ブロック level 行の穴の列を, 下の行から順に rng から引く. GameCore::freeze() と探索で同じ引き方をする
+inline void drawGarbageHoles(Rng &rng, int level, int *spaces)
+{
+    for (int i = 0; i < level; i++)
+        spaces[i] = rng.nextInt(1, 10);
+}
+
+// 探索の中で, まだ入っていないお邪魔ブロック level 行を board に入れる. 本当の穴の列はゲームの乱数の先にあって分からないので,
+// 盤面のハッシュを種にした乱数で引く. 同じ盤面なら同じ穴になるので, 探索の結果は呼ぶ順番やスレッド数によらない
+inline void raiseGuessedGarbage(Bitboard &board, int level)
+{
+    Rng holes(board.hash);
+    int spaces[STAGE_HEIGHT];
+    drawGarbageHoles(holes, level, spaces);
+    board.raise(level, spaces);
+}
+
+// 相手の盤面を読むための小さな複製. 色もツモも乱数も持たないので, 毎手写しても GameCore の複製より安い
+struct OpponentSnapshot
+{
+    Bitboard board;
+    Piece piece;
+    int pendingGarbage = 0; /* 相手に溜まっている (こちらが送った) お邪魔ブロックの行数 */
+    bool valid = false;     /* 相手がいない (か負けている) なら false */
+};
+
+// 相手から来そうな攻撃. 相手が今のブロックを ticks 後に固定すると rows 行来る.
+// 自分に溜まっている分 (pendingGarbage) とは別に数える. 探索では, 自分の固定より先に届く置き方 (rowsBefore()) だけに効かせる
+struct IncomingAttack
+{
+    int rows = 0;
+    int ticks = 0;
+
+    // ticks 後に固定するブロックが固定の前に受け取る行数. 1tickに1マス落ちるので, 落ちる段数がそのまま tick 数になる
+    int rowsBefore(int lockTicks) const
+    {
+        return lockTicks >= ticks ? rows : 0;
+    }
+};
+
+class GameCore
+{
+public:
+    GameCore() {}
+
+    // ツモとお邪魔ブロックの穴の位置をこの種から決め直す
+    void seed(uint64_t seed)
+    {
+        rng.seed(seed);
+        bag.reset();
+        hasNext = false;
+    }
+
+    void reset()
+    {
+        winFlag = true;
+        board.reset();
+        clearedRows = 0;
+        pendingGarbage = 0;
+        sentGarbage = 0;
+
+        this->spawn();
+    }
+
+    // 次のブロックを出す
+    void spawn()
+    {
+        piece = spawnPiece(hasNext ? nextType : bag.next(rng));
+        nextType = bag.next(rng);
+        hasNext = true;
+
+        // 追加してすぐ重なるようなら、負け. 山が出現位置に届いていなければ重なりようがない
+        if (board.maxHeight >= piece.y + piece.shape().minY && checkStageOverlap())
+        {
+            winFlag = false;
+        }
+    }
+
+    bool checkStageOverlap() const
+    {
+        return board.overlaps(piece.shape(), piece.x, piece.y);
+    }
+
+    // 行動を処理. 壁やブロックにめり込むなど、行動を巻き戻す必要があった場合はtrueを返す.
+    bool act(Action action)
+    {
+        return applyAction(board, piece, action);
+    }
+
+    // 1マス落とす. 着地したら固定して消した行数を返す. まだ落ちている間は -1
+    int drop()
+    {
+        piece.y--;
+
+        // 衝突判定
+        if (checkStageOverlap())
+        {
+            piece.y++;
+            return this->freeze();
+        }
+        return -1;
+    }
+
+    // 今のブロックを固定して消した行数を返す. ブロックが既に盤面と重なっていたら固定できないので, 負けにして 0 を返す
+    int freeze()
+    {
+        sentGarbage = 0;
+        if (checkStageOverlap())
+        {
+            winFlag = false;
+            clearedRows = 0;
+            return 0;
+        }
+
+        board.put(piece.shape(), piece.x, piece.y, piece.type);
+        clearedRows = board.clearLines();
+        int lines = __builtin_popcount(clearedRows);
+
+        // 自分に来ているお邪魔ブロックがあれば先に相殺する
+        int attack = attackForLines(lines);
+        int canceled = std::min(attack, pendingGarbage);
+        pendingGarbage -= canceled;
+        sentGarbage = attack - canceled;
+
+        // 相殺しきれなかった分は, ここでまとめて1回だけせり上げる
+        if (pendingGarbage > 0)
+        {
+            int level = std::min(pendingGarbage, STAGE_HEIGHT - 1);
+            int spaces[STAGE_HEIGHT];
+            drawGarbageHoles(rng, level, spaces);
+            board.raise(level, spaces);
+            pendingGarbage = 0;
+        }
+        return lines;
+    }
+
+    // 相手から level 行のお邪魔ブロックが来た. 落下中の盤面は変えずに溜めておき,
+    // 次にブロックを固定するときに相殺してから入れる
+    void attack(int level)
+    {
+        pendingGarbage += level;
+    }
+
+    // 相手から見たこのゲーム
+    OpponentSnapshot snapshot() const
+    {
+        OpponentSnapshot result;
+        result.board = board;
+        result.piece = piece;
+        result.pendingGarbage = pendingGarbage;
+        result.valid = winFlag;
+        return result;
+    }
+
+    // 今のブロックを固定して lines 行消したときに, 相殺しきれずに入るお邪魔ブロックを board に入れる.
+    // incoming は固定までに溜まっているとみなす行数. 穴の列は raiseGuessedGarbage() で決める (ゲームの乱数は読まない)
+    void previewGarbage(Bitboard &board, int lines, int incoming) const
+    {
+        int level = std::min(incoming - attackForLines(lines), STAGE_HEIGHT - 1);
+        if (level > 0)
+            raiseGuessedGarbage(board, level);
+    }
+
+    Board board;
+    Piece piece;
+    int nextType = 0;
+    bool hasNext = false;
+    bool winFlag = true;
+    uint32_t clearedRows = 0; /* 最後に固定したときに消えた行 (bit y が消す前の行 y). 演出や攻撃の計算用 */
+    int pendingGarbage = 0;   /* まだ盤面に入れていないお邪魔ブロックの行数 */
+    int sentGarbage = 0;      /* 最後に固定したときに相手へ送る行数 (相殺した残り) */
+    Rng rng;
+    Bag bag;
+};
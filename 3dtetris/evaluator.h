@@ -0,0 +1,181 @@
+#pragma once
+
+// 盤面の評価. 特徴量を数えて重みをかけるだけで, 入出力はしない.
+// 高さ・穴・凸凹は盤面が覚えているものを読み, 残りは10列の配列と行のビットマスクの上で分岐せずに数える
+// (列のループはコンパイラがベクトル化できる形にしてある)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "board.h"
+
+struct EvalFeatures
+{
+    int heightSum;
+    int heightSquares;     /* 高さの2乗の合計 */
+    int bumpiness;         /* 隣との高さの差の合計 */
+    int weightedBumpiness; /* 隣との高さの差に高さをかけた合計 */
+    int holes;
+    int wells;             /* 両隣より低い列の深さの合計. 左右の壁は盤面の上まであるとする */
+    int rowTransitions;    /* 行の中で埋まり/空きが切り替わる回数 (壁との境も数える). 一番高い列まで */
+};
+
+// 評価値 = base - Σ 重み * 特徴量. 高いほど良い. 重みによっては負にもなる
+struct EvalWeights
+{
+    int base;
+    int heightSum;
+    int heightSquares;
+    int bumpiness;
+    int weightedBumpiness;
+    int holes;
+    int wells;
+    int rowTransitions;
+};
+
+// 置けない (負け) 盤面の評価値. どの重みで評価した盤面よりも低い. 足し引きするときは桁あふれに気をつける
+constexpr int SCORE_LOSS = std::numeric_limits<int>::lowest();
+
+inline EvalFeatures evalFeatures(const Bitboard &board)
+{
+    EvalFeatures features;
+    features.heightSum = board.heightSum;
+    features.bumpiness = board.bumpiness;
+    features.holes = board.holes;
+
+    // 壁の列を盤面の上までの高さにした, 左右1列ずつ広い高さ
+    int sides[STAGE_WIDTH];
+    for (int x = 0; x < STAGE_WIDTH; x++)
+        sides[x] = board.heights[x];
+    sides[0] = sides[STAGE_WIDTH - 1] = STAGE_HEIGHT - 1;
+
+    int squares = 0, weighted = 0, wells = 0;
+    for (int x = 1; x <= 10; x++)
+    {
+        int h = board.heights[x];
+        int left = board.heights[x - 1]; /* 凸凹は左の壁を高さ0として見る (Bitboard::bumpiness と同じ) */
+        squares += h * h;
+        weighted += std::abs(h - left) * h;
+        int depth = std::min(sides[x - 1], sides[x + 1]) - h;
+        wells += depth > 0 ? depth : 0;
+    }
+    features.heightSquares = squares;
+    features.weightedBumpiness = weighted;
+    features.wells = wells;
+
+    // 隣り合う12列の11組を, 1行ずらした XOR でまとめて比べる
+    int transitions = 0;
+    for (int y = 1; y <= board.maxHeight; y++)
+        transitions += __builtin_popcount((board.rows[y] ^ (board.rows[y] >> 1)) & 0x07FF);
+    features.rowTransitions = transitions;
+    return features;
+}
+
+inline int evaluateBoard(const Bitboard &board, const EvalWeights &weights)
+{
+    EvalFeatures features = evalFeatures(board);
+    return weights.base
+        - weights.heightSum * features.heightSum
+        - weights.heightSquares * features.heightSquares
+        - weights.bumpiness * features.bumpiness
+        - weights.weightedBumpiness * features.weightedBumpiness
+        - weights.holes * features.holes
+        - weights.wells * features.wells
+        - weights.rowTransitions * features.rowTransitions;
+}
+
+// もとの evaluateStage(). 高さの合計・凸凹・穴
+constexpr EvalWeights WEIGHTS_CLASSIC = {50000, 7, 0, 1, 0, 30, 0, 0};
+// もとの evaluateStage2(). 高い列ほど重く見る
+constexpr EvalWeights WEIGHTS_TOP_HEAVY = {50000, 0, 7, 0, 1, 30, 0, 0};
+// 井戸と行の切り替わりも見る
+constexpr EvalWeights WEIGHTS_SHAPE = {50000, 5, 0, 2, 0, 40, 3, 4};
+
+struct NamedWeights
+{
+    const char *name;
+    EvalWeights weights;
+};
+
+constexpr NamedWeights WEIGHT_PRESETS[] = {
+    {"classic", WEIGHTS_CLASSIC},
+    {"top-heavy", WEIGHTS_TOP_HEAVY},
+    {"shape", WEIGHTS_SHAPE},
+};
+
+// 名前から組み込みの重みを探す. なければ nullptr
+inline const EvalWeights *findWeights(const char *name)
+{
+    for (const NamedWeights &preset : WEIGHT_PRESETS)
+    {
+        if (strcmp(preset.name, name) == 0)
+            return &preset.weights;
+    }
+    return nullptr;
+}
+
+// 重みのファイルは「名前 値」を1行ずつ並べたテキスト. 書いていない重みは 0 にする.
+// tune が書き出し, main や batch が読む
+struct WeightField
+{
+    const char *name;
+    int EvalWeights::*field;
+};
+
+constexpr WeightField WEIGHT_FIELDS[] = {
+    {"base", &EvalWeights::base},
+    {"heightSum", &EvalWeights::heightSum},
+    {"heightSquares", &EvalWeights::heightSquares},
+    {"bumpiness", &EvalWeights::bumpiness},
+    {"weightedBumpiness", &EvalWeights::weightedBumpiness},
+    {"holes", &EvalWeights::holes},
+    {"wells", &EvalWeights::wells},
+    {"rowTransitions", &EvalWeights::rowTransitions},
+};
+
+inline bool saveWeights(const char *path, const EvalWeights &weights)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+    for (const WeightField &field : WEIGHT_FIELDS)
+        fprintf(file, "%s %d\n", field.name, weights.*field.field);
+    return fclose(file) == 0;
+}
+
+// 知らない名前があれば false. path が組み込みの重みの名前ならそれを使う
+inline bool loadWeights(const char *path, EvalWeights &weights)
+{
+    if (const EvalWeights *preset = findWeights(path))
+    {
+        weights = *preset;
+        return true;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+    EvalWeights loaded{};
+    char name[64];
+    int value;
+    bool ok = true;
+    while (ok && fscanf(file, "%63s %d", name, &value) == 2)
+    {
+        ok = false;
+        for (const WeightField &field : WEIGHT_FIELDS)
+        {
+            if (strcmp(field.name, name) == 0)
+            {
+                loaded.*field.field = value;
+                ok = true;
+            }
+        }
+    }
+    fclose(file);
+    if (ok)
+        weights = loaded;
+    return ok;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+// 書き手1つ・読み手1つのロックを使わない郵便受け (3つのバッファを回す).
+// 読み手には一番新しい値だけが届き, 読まれなかった古い値は上書きされる. どちらの側も待たない
+template <typename T>
+class Mailbox
+{
+public:
+    // 書き手: 次に出す値を書く場所. publish() までは読み手から見えない
+    T &writeSlot()
+    {
+        return slots[back];
+    }
+
+    // 書き手: writeSlot() に書いた値を出す
+    void publish()
+    {
+        int old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = old & INDEX;
+    }
+
+    // 読み手: 前に取ってから新しい値が出ていれば, それを指す. なければ nullptr.
+    // 次に take() を呼ぶまで書き手はこの値に触らない
+    const T *take()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return nullptr;
+        int old = middle.exchange(front, std::memory_order_acq_rel);
+        front = old & INDEX;
+        return &slots[front];
+    }
+
+private:
+    static constexpr int INDEX = 3;
+    static constexpr int FRESH = 4; /* 真ん中のバッファにまだ読まれていない値がある */
+
+    T slots[3];
+    alignas(64) std::atomic<int> middle{1};
+    alignas(64) int back = 0; /* 書き手だけが触る */
+    alignas(64) int front = 2; /* 読み手だけが触る */
+};
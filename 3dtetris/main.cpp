@@ -12,6 +12,8 @@
 #include <stack>
 #include <functional>
 #include <unordered_set>
+#include <algorithm>
+#include <cstdlib>
 
 #include "util.h"
 #include "model.h"
@@ -88,21 +90,24 @@ const char *vertexShaderSource = R"(
     layout(location=0) in vec3 aPos;
     layout(location=1) in vec3 aNormal;
     layout(location=2) in vec3 aTexChoords;
+    layout(location=3) in mat4 aModel;
+    layout(location=7) in vec3 aColor;
 
     out vec3 Normal;
     out vec3 FragPos;
     out vec4 FragPosLightSpace;
+    out vec3 Color;
 
-    uniform mat4 MVP;
-    uniform mat4 M;
+    uniform mat4 VP;
     uniform mat4 lightSpaceMatrix;
 
     void main()
     {
-        gl_Position = MVP * vec4(aPos, 1.0);
-        FragPos = vec3(M * vec4(aPos, 1.0));
+        FragPos = vec3(aModel * vec4(aPos, 1.0));
+        gl_Position = VP * vec4(FragPos, 1.0);
         FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
-        Normal = transpose(inverse(mat3(M))) * aNormal;
+        Normal = transpose(inverse(mat3(aModel))) * aNormal;
+        Color = aColor;
     }
 )";
 
@@ -112,11 +117,11 @@ const char *fragmentShaderSource = R"(
     in vec3 Normal;
     in vec3 FragPos;
     in vec4 FragPosLightSpace;
+    in vec3 Color;
 
     out vec4 FragColor;
 
     uniform vec3 lightPos;
-    uniform vec3 objectColor;
     uniform sampler2D depthMap;
 
     float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
@@ -157,7 +162,7 @@ const char *fragmentShaderSource = R"(
 
         float shadow = ShadowCalculation(FragPosLightSpace, norm, lightDir);
 
-        vec3 result = (ambient + (1-shadow) * diffuse) * objectColor;
+        vec3 result = (ambient + (1-shadow) * diffuse) * Color;
         FragColor = vec4(result, 1.0);
     }  
 )";
@@ -165,13 +170,13 @@ const char *fragmentShaderSource = R"(
 const char *shadowVertexShaderSource = R"(
     #version 330 core
     layout (location = 0) in vec3 aPos;
+    layout (location = 3) in mat4 aModel;
 
     uniform mat4 lightSpaceMatrix;
-    uniform mat4 M;
 
     void main()
     {
-        gl_Position = lightSpaceMatrix * M * vec4(aPos, 1.0);
+        gl_Position = lightSpaceMatrix * aModel * vec4(aPos, 1.0);
     }  
 
 )";
@@ -185,8 +190,18 @@ const char *shadowFragmentShaderSource = R"(
     }
 )";
 
-int main()
+// ./main [1秒あたりのシミュレーションのtick数] [コンピュータの評価の重み (tune が書いたファイルか組み込みの名前)] [コンピュータの思考 (beam か mcts)]
+int main(int argc, char **argv)
 {
+    int tickRate = argc > 1 ? std::max(1, atoi(argv[1])) : 60;
+    EvalWeights cpuWeights = WEIGHTS_CLASSIC;
+    if (argc > 2 && !loadWeights(argv[2], cpuWeights))
+    {
+        std::cerr << "Failed to load weights " << argv[2] << std::endl;
+        return -1;
+    }
+    bool cpuMcts = argc > 3 && strcmp(argv[3], "mcts") == 0;
+
     // GLFWの初期化とウィンドウの作成
     if (!glfwInit())
     {
@@ -237,6 +252,14 @@ int main()
 
     Game *game1 = new Game(); game1->position = glm::vec3(0,0,0);
     CPUGame *game2 = new CPUGame(); game2->position = glm::vec3(18,0,0);
+    game2->setWeights(cpuWeights);
+    if (cpuMcts)
+    {
+        // 試し打ちは考える時間いっぱいまで続ける
+        MctsConfig mctsConfig;
+        mctsConfig.rolloutBudget = 1 << 30;
+        game2->setMcts(mctsConfig);
+    }
     game1->add();
     game2->add();
     game1->enemyGame = game2;
@@ -252,6 +275,7 @@ int main()
     shadowProgram.addShader(GL_FRAGMENT_SHADER, shadowFragmentShaderSource);
     shadowProgram.link();
     glm::mat4 ident = glm::mat4(1);
+    CubeBatch cubeBatch;
 
     GLuint depthMapFBO;
     glGenFramebuffers(1, &depthMapFBO);
@@ -277,26 +301,38 @@ int main()
     //  glEnable(GL_CULL_FACE);
     //  initOpenGLDebug();
 
-    // メインループ
-    double previousTime = glfwGetTime();
-    unsigned int stepCounter = 0;
-    while (!glfwWindowShouldClose(window))
-    {
-        double currentTime = glfwGetTime();
-        double deltaTime = currentTime - previousTime;
-        previousTime = currentTime;
-        stepCounter++;
+    // シミュレーションは描画と切り離して一定間隔 (tickRate 回/秒) で進める.
+    // 重力とキーの連射は tick で数えるので, 画面のリフレッシュレートに左右されない
+    const double tickSeconds = 1.0 / tickRate;
+    const unsigned int gravityTicks = std::max(1, tickRate / 3);
+    game1->keyRepeatTicks = tickRate / 2;
+    game2->keyRepeatTicks = tickRate / 2;
+
+    // T: ターボ (1フレームに入るだけtickを進める), R: ターボ中に描画を止める
+    bool turbo = false;
+    bool rendering = true;
+    const double turboFrameBudget = 1.0 / 60;
 
+    unsigned int tickCounter = 0;
+    auto simulateTick = [&]()
+    {
+        tickCounter++;
         for (int i = 0; i < 512; i++)
             if (gKeyPressed[i] != 0)
                 gKeyPressed[i]++;
 
-        // ウィンドウのクリア
-        glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
-        // glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (gKeyPressed[GLFW_KEY_T] == 2)
+        {
+            turbo = !turbo;
+            rendering = true;
+        }
+        if (gKeyPressed[GLFW_KEY_R] == 2 && turbo)
+            rendering = !rendering;
 
-        if (stepCounter % 20 == 0)
+        game1->beginTick();
+        game2->beginTick();
+
+        if (tickCounter % gravityTicks == 0)
         {
             game1->step();
             game2->step();
@@ -307,16 +343,60 @@ int main()
             game2->update();
         }
 
-        if (!game1->winFlag || !game2->winFlag) {
+        if (!game1->core.winFlag || !game2->core.winFlag) {
             game1->reset();
             game2->reset();
         }
+    };
+
+    // メインループ
+    double previousTime = glfwGetTime();
+    double accumulator = 0;
+    while (!glfwWindowShouldClose(window))
+    {
+        double currentTime = glfwGetTime();
+        double deltaTime = currentTime - previousTime;
+        previousTime = currentTime;
+
+        if (turbo)
+        {
+            // 描画の間 (描画しないなら毎回) 予算の時間だけ回す
+            do
+            {
+                simulateTick();
+            } while (turbo && glfwGetTime() - currentTime < turboFrameBudget);
+            accumulator = 0;
+        }
+        else
+        {
+            // 止まっていた後に一気に追いつこうとしないよう, 溜める時間には上限をつける
+            accumulator += std::min(deltaTime, 0.25);
+            while (accumulator >= tickSeconds)
+            {
+                simulateTick();
+                accumulator -= tickSeconds;
+            }
+        }
+
+        if (!rendering)
+        {
+            glfwPollEvents();
+            continue;
+        }
+
+        game1->renderAlpha = turbo ? 1.f : (float)(accumulator / tickSeconds);
+        game2->renderAlpha = game1->renderAlpha;
+
+        // ウィンドウのクリア
+        glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
+        // glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // tet0->rotation = glm::quat(rotation.x(), rotation.y(), rotation.z(), rotation.w());
         // tet0->position = glm::vec3(position.x(), position.y(), position.z());
         // std::cout << position.y() << std::endl;
 
-        float sensitivity = 0.1f;
+        float sensitivity = 6.f * (float)deltaTime;
         if (gKeyPressed[GLFW_KEY_A] > 0)
         {
             cameraPosition.x -= sensitivity;
@@ -356,6 +436,12 @@ int main()
         glm::mat4 lightView = glm::lookAt(lightPosition, lightPosition + lightDirection, worldUp);
         glm::mat4 lightSpaceMatrix = lightProjection * lightView;
 
+        // 両方の盤面のキューブを集めて1回だけ送り, 影と本描画のパスでそれぞれ1回の描画で描く
+        cubeBatch.clear();
+        game1->render(cubeBatch, ident);
+        game2->render(cubeBatch, ident);
+        cubeBatch.upload();
+
         // 1. first render to depth map
         shadowProgram.use();
         glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
@@ -363,8 +449,7 @@ int main()
         glClear(GL_DEPTH_BUFFER_BIT);
         unsigned int location = shadowProgram.getLocation("lightSpaceMatrix");
         glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-        game1->render(&shadowProgram, ident, ident, ident);
-        game2->render(&shadowProgram, ident, ident, ident);
+        cubeBatch.draw();
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
         program.use();
@@ -374,12 +459,9 @@ int main()
         glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + cameraDirection, worldUp);
         glUniform3fv(program.getLocation("lightPos"), 1, glm::value_ptr(cameraPosition));
         glUniformMatrix4fv(program.getLocation("lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+        glUniformMatrix4fv(program.getLocation("VP"), 1, GL_FALSE, glm::value_ptr(pers * view));
         glBindTexture(GL_TEXTURE_2D, depthMap);
-        // tet1.render(&program, ident, pers, view);
-        game1->render(&program, ident, pers, view);
-        game2->render(&program, ident, pers, view);
-        // grid->render(&program, ident, pers, view);
-        // cube2.render(&program, ident, pers, view);
+        cubeBatch.draw();
 
         // ダブルバッファリング
         glfwSwapBuffers(window);
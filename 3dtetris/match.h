@@ -0,0 +1,162 @@
+#pragma once
+
+// コンピュータ同士の対戦をウィンドウなしで最後まで進める
+
+#include <cstdint>
+
+#include "core.h"
+#include "ai.h"
+#include "mcts.h"
+#include "replay.h"
+
+struct MatchResult
+{
+    int winner = -1; /* 0 か 1. 決着がつかなければ -1 */
+    int ticks = 0;
+    int pieces[2] = {0, 0};
+    int lines[2] = {0, 0};
+    int attacks[2] = {0, 0}; /* 送ったお邪魔ブロックの行数 */
+};
+
+class Match
+{
+public:
+    Match(uint32_t seed) : seed(seed), cpus{CpuPlayer(games[0]), CpuPlayer(games[1])}, mcts{{games[0]}, {games[1]}}
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            cpus[i].verbose = false;
+            cpus[i].table = &tables[i];
+        }
+    }
+
+    // main() の1ステップ (全員1回ずつ行動して1マス落ちる) を決着がつくまで繰り返す.
+    // どちらかが maxPieces 個置いたら引き分け
+    MatchResult play(int maxPieces)
+    {
+        uint64_t state = seed;
+        MatchResult result;
+        for (int i = 0; i < 2; i++)
+        {
+            games[i].seed(Rng::splitmix64(state));
+            games[i].reset();
+            cpus[i].clearActions();
+            think(i);
+        }
+
+        while (games[0].winFlag && games[1].winFlag)
+        {
+            if (recorder)
+                recorder->snapshot(result.ticks, games);
+            if (result.pieces[0] >= maxPieces || result.pieces[1] >= maxPieces)
+                break;
+
+            result.ticks++;
+            for (int i = 0; i < 2; i++)
+            {
+                GameCore &game = games[i];
+                CpuPlayer &cpu = cpus[i];
+
+                Action action = cpu.popAction();
+                game.act(action);
+                if (recorder)
+                    recorder->action(result.ticks, i, action);
+
+                int level = game.drop();
+                if (level < 0)
+                    continue;
+
+                // お邪魔ブロックは相手の次の固定まで溜まるだけだが, 相手の盤面を読む側は溜まった分を見て考え直す (CPUGame と同じ).
+                // 考え直すときはこちらの盤面と次のブロックも読むので, こちらのブロックを出した後にする
+                result.pieces[i]++;
+                result.lines[i] += level;
+                int sent = game.sentGarbage;
+                if (sent > 0)
+                {
+                    result.attacks[i] += sent;
+                    games[1 - i].attack(sent);
+                    if (recorder)
+                        recorder->garbage(result.ticks, i, sent);
+                }
+                game.spawn();
+                cpu.clearActions();
+                think(i);
+                if (sent > 0 && opponentAware[1 - i])
+                    think(1 - i);
+            }
+        }
+
+        if (games[0].winFlag != games[1].winFlag)
+            result.winner = games[0].winFlag ? 0 : 1;
+        if (recorder)
+            recorder->end(result.ticks, result.winner);
+        return result;
+    }
+
+    const GameCore &getGame(int i) const
+    {
+        return games[i];
+    }
+
+    // player の評価の重みを変える. 覚えていた評価値は使えなくなるので置換表も空にする
+    void setWeights(int player, const EvalWeights &weights)
+    {
+        cpus[player].weights = weights;
+        mcts[player].weights = weights;
+        tables[player].clear();
+    }
+
+    void setSearchConfig(int player, const SearchConfig &config)
+    {
+        cpus[player].config = config;
+    }
+
+    // player をビームサーチの代わりにモンテカルロ木探索で考えさせる
+    void setMcts(int player, const MctsConfig &config)
+    {
+        useMcts[player] = true;
+        mcts[player].config = config;
+    }
+
+    // player が相手の盤面から来そうなお邪魔ブロックを読み, 溜まったときに考え直すか
+    void setOpponentAware(int player, bool aware)
+    {
+        opponentAware[player] = aware;
+    }
+
+    // play() で起きたことを recorder に書き出す. nullptr なら記録しない
+    void record(ReplayWriter *recorder)
+    {
+        this->recorder = recorder;
+    }
+
+private:
+    // player の今のブロックの行動列を計画する
+    void think(int player)
+    {
+        IncomingAttack threat;
+        if (opponentAware[player])
+            threat = estimateAttack(games[1 - player].snapshot(), threatGenerator);
+        cpus[player].expectedAttack = threat;
+        mcts[player].expectedAttack = threat;
+        if (!useMcts[player])
+        {
+            cpus[player].stageTraversal();
+            return;
+        }
+        Piece target;
+        cpus[player].clearActions();
+        if (mcts[player].choosePlacement(target))
+            cpus[player].planTo(target);
+    }
+
+    uint32_t seed;
+    GameCore games[2];
+    TranspositionTable tables[2]; /* 評価の重みを変えても混ざらないよう, 1人に1つ */
+    CpuPlayer cpus[2];
+    MctsPlayer mcts[2];
+    bool useMcts[2] = {false, false};
+    bool opponentAware[2] = {true, true};
+    PlacementGenerator threatGenerator; /* estimateAttack() 用 */
+    ReplayWriter *recorder = nullptr;
+};
@@ -0,0 +1,422 @@
+#pragma once
+
+// モンテカルロ木探索のコンピュータ. 今のブロックの置き方を根の子とし, 何度か試した子は次のブロック (種類が分かっている) の
+// 置き方を孫として木を伸ばす. 葉から先の数手は盤面の複製の上で試し打ち (ツモはバッグの残りから乱数で引き, 1手の評価で
+// 一番良い位置に置く) して, 結果を葉から根までの全部のノードに足す. どの段でも平均の良い方ほど多く試す (UCB).
+// 次のブロックと組み合わせて行を消しお邪魔ブロックを送る形は木の中で, さらに先の形は試し打ちの中で見える.
+// 試し打ちはプールのスレッドで並べて走らせ, 試している最中の子には仮の負けを足しておいて (virtual loss),
+// 他のスレッドが同じ子に集まらないようにする
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "core.h"
+#include "evaluator.h"
+#include "movegen.h"
+#include "thread_pool.h"
+
+// ビームサーチ (1手 1ms 弱) より1桁遅いのは承知の上で, その分を送る行数に使う設定にしてある.
+// この既定値で 1スレッドあたり 150 手/秒ほど. ビームサーチ相手の 300 手の対戦で送る行数はおよそ 1.5 倍で, 8 戦なら 2勝 6分けくらい.
+// 時間のあるウィンドウ版は rolloutBudget を上げて timeBudgetUs で締め切る
+struct MctsConfig
+{
+    int candidates = 8;          /* 1つのノードの子の数 (根では今のブロック, 根の子では次のブロックの置き方). 1手の評価の良い順 */
+    int expandVisits = 8;        /* 根の子をこれだけ試したら, 次のブロックの置き方を子にして木を伸ばす */
+    int rolloutDepth = 4;        /* 根の子の後に置くブロックの数 (次のブロックを含む). 孫から試すときは1つ少なく置く */
+    int rolloutBudget = 200;     /* 1手で試し打ちする回数の上限 */
+    int timeBudgetUs = 0;        /* 1手にかける時間の上限 (マイクロ秒). 0 なら制限なし. 各子の1回目は必ず試す */
+    int attackValue = 50;        /* 送るお邪魔ブロック1行を評価値いくつとみなすか */
+    int virtualLoss = 2;         /* 試している最中の子に足しておく, 一番悪い結果の回数 */
+    double exploration = 1.0;    /* UCB の探索の重み */
+    double valueScale = 200;     /* UCB で評価値のこの差を 1 とみなす. 良い手同士の差に合わせる */
+    int lossMargin = 2000;       /* 途中で負けた試し打ちを, 生き残った試し打ちの一番悪い結果よりこれだけ低い評価値とみなす */
+};
+
+class MctsPlayer
+{
+public:
+    MctsPlayer(const GameCore &game) : game(game) {}
+
+    bool verbose = false;       /* 選んだ置き方と試した回数を標準出力に出す */
+    ThreadPool *pool = nullptr; /* 試し打ちを分けて走らせるプール. nullptr なら呼んだスレッドだけで試す */
+    std::function<bool()> interrupt; /* true を返したら, 締め切りと同じくそこまでの結果で決める */
+    EvalWeights weights = WEIGHTS_CLASSIC;
+    IncomingAttack expectedAttack; /* estimateAttack() の結果 */
+    MctsConfig config;
+
+    // 置き方を選んで, 固定される位置を target に入れる. 置けなければ false.
+    // プールを使わず締め切りもなければ, 同じ状態からはいつも同じ置き方を選ぶ
+    bool choosePlacement(Piece &target)
+    {
+        rollouts = 0;
+        cutOff = false;
+        deadline = std::chrono::steady_clock::time_point::max();
+        if (config.timeBudgetUs > 0)
+            deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(config.timeBudgetUs);
+
+        expandRoot();
+        if (rootCount == 0)
+            return false;
+
+        int threads = pool && pool->size() > 1 ? pool->size() : 1;
+        if ((int)workers.size() < threads)
+            workers.resize(threads);
+        for (int w = 0; w < threads; w++)
+        {
+            uint64_t seed = game.board.hash ^ ((uint64_t)game.piece.type << 56) ^ (uint64_t)w;
+            workers[w].rng.seed(seed);
+        }
+        if (threads > 1)
+            pool->parallelFor(threads, [this](int begin, int end) {
+                for (int w = begin; w < end; w++)
+                    work(workers[w]);
+            });
+        else
+            work(workers[0]);
+
+        // 一番多く試した根の子. 回数が同じなら平均の良い方, それも同じなら前の方
+        int best = 0;
+        for (int c = 1; c < rootCount; c++)
+        {
+            const Node &a = nodes[c], &b = nodes[best];
+            if (a.visits > b.visits || (a.visits == b.visits && a.visits > 0 && meanOf(a) > meanOf(b)))
+                best = c;
+        }
+        target = nodes[best].piece;
+
+        if (verbose)
+            std::cout << "mcts " << target.x << " " << target.y << " " << target.rotnum << " (" << rollouts
+                      << " rollouts, " << nodes.size() << " nodes, " << nodes[best].visits << " visits, "
+                      << nodes[best].losses << " lost, mean " << (int)(nodes[best].visits > 0 ? meanOf(nodes[best]) : 0)
+                      << (cutOff ? ", cut off" : "") << ")" << std::endl;
+        return true;
+    }
+
+    // 直前の choosePlacement() で試し打ちした回数
+    int lastRolloutCount() const
+    {
+        return rollouts;
+    }
+
+    // 直前の探索が締め切りか interrupt で打ち切られたか
+    bool wasCutOff() const
+    {
+        return cutOff;
+    }
+
+private:
+    // 木のノード. 根そのものは持たず, nodes の先頭 rootCount 個が根の子. 統計と子の範囲は mutex の中でだけ触る
+    struct Node
+    {
+        Piece piece;       /* このノードで置いたブロック */
+        Bitboard board;    /* 置いて行を消し, お邪魔ブロックを入れた後 */
+        int attack;        /* 根からここまでに送った行数 */
+        int carried;       /* ここより後に相手から来そうな行数. 次の固定で入れる */
+        int depth;         /* 根から置いたブロックの数. 根の子が 1 */
+        int first = -1;    /* 子の先頭 (nodes の添字). まだ伸ばしていなければ -1 */
+        int count = 0;     /* 子の数 */
+        bool expanded = false;
+        int visits = 0;    /* 負けた試し打ちも数える */
+        int losses = 0;    /* 途中で置けなくなった試し打ちの数 */
+        int virtualVisits = 0;
+        double total = 0;  /* 生き残った試し打ちの結果の合計 */
+    };
+
+    // スレッドごとの作業場
+    struct Worker
+    {
+        std::vector<Piece> drops;
+        Rng rng;
+    };
+
+    // board に placement を置いて行を消し, 送る行数を attack に入れる
+    static Bitboard lock(const Bitboard &board, const Piece &piece, int &attack)
+    {
+        Bitboard result = board;
+        result.put(piece.shape(), piece.x, piece.y);
+        attack = attackForLines(__builtin_popcount(result.clearLines()));
+        return result;
+    }
+
+    int score(const Bitboard &board, int attack) const
+    {
+        return evaluateBoard(board, weights) + config.attackValue * attack;
+    }
+
+    // 試し打ちで使う安い置き方の列挙. 出現位置で回してから左右に動き, そのまま真下に落とした位置だけを出す.
+    // PlacementGenerator の幅優先より1桁速い代わりに, 差し込みや回転入れは見ない. 出現位置で重なれば何も出さない.
+    // 他の向きと同じ形になる向き (O の 1〜3, I・S・Z の 2 と 3) は, 左右にずらせば同じセルを埋めるので飛ばす
+    static void dropPlacements(const Bitboard &board, int type, std::vector<Piece> &drops)
+    {
+        drops.clear();
+        for (int rotnum = 0; rotnum < 4; rotnum++)
+        {
+            if (pieceSameCells(type, rotnum) != rotnum)
+                continue;
+            Piece piece = spawnPiece(type);
+            piece.rotnum = rotnum;
+            const PieceShape &shape = piece.shape();
+            if (board.overlaps(shape, piece.x, piece.y))
+                continue;
+            for (int direction = -1; direction <= 1; direction += 2)
+            {
+                // 右へは出現位置の1つ右から. 出現位置そのものは左へ行くときに出す
+                for (int x = direction < 0 ? SPAWN_X : SPAWN_X + 1; !board.overlaps(shape, x, SPAWN_Y); x += direction)
+                {
+                    int y = SPAWN_Y;
+                    while (!board.overlaps(shape, x, y - 1))
+                        y--;
+                    piece.x = x;
+                    piece.y = y;
+                    drops.push_back(piece);
+                }
+            }
+        }
+    }
+
+    // 今のブロックを置いて行を消し, 相殺しきれなかったお邪魔ブロックをせり上げた盤面. 送る行数を attack に,
+    // 相手から来そうな攻撃のうち固定した後に来る分を carried に入れる
+    Bitboard lockRoot(const Piece &piece, int &attack, int &carried) const
+    {
+        Bitboard result = game.board;
+        result.put(piece.shape(), piece.x, piece.y);
+        int lines = __builtin_popcount(result.clearLines());
+        attack = attackForLines(lines);
+        int arriving = expectedAttack.rowsBefore(game.piece.y - piece.y);
+        carried = expectedAttack.rows - arriving;
+        game.previewGarbage(result, lines, game.pendingGarbage + arriving);
+        return result;
+    }
+
+    // 今のブロックの置き方を1手の評価で並べ, 良い方から config.candidates 個を根の子にする.
+    // せり上がって次のブロックが出られなくなる置き方は負け (SCORE_LOSS) として一番後ろに並べる. その子の試し打ちは負けになる
+    void expandRoot()
+    {
+        nodes.clear();
+        nodes.reserve(config.candidates * (config.candidates + 1)); /* 伸ばしても並べ替えが起きないように */
+        rootGenerator.generate(game.board, game.piece);
+        std::vector<std::pair<int, int>> ranked; /* (評価値, 置き方の番号) */
+        const std::vector<Placement> &placements = rootGenerator.placements();
+        Piece next = spawnPiece(game.nextType);
+        for (int i = 0; i < (int)placements.size(); i++)
+        {
+            int attack, carried;
+            Bitboard board = lockRoot(placements[i].piece, attack, carried);
+            bool blocked = game.hasNext && board.overlaps(next.shape(), next.x, next.y);
+            ranked.push_back({blocked ? SCORE_LOSS : score(board, attack), i});
+        }
+        std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+            return a.first > b.first;
+        });
+        for (int i = 0; i < (int)ranked.size() && i < config.candidates; i++)
+        {
+            Node child;
+            child.piece = placements[ranked[i].second].piece;
+            child.board = lockRoot(child.piece, child.attack, child.carried);
+            child.depth = 1;
+            nodes.push_back(child);
+        }
+        rootCount = (int)nodes.size();
+        hasLowest = false;
+    }
+
+    // 根の子 nodes[n] に次のブロックの置き方を1手の評価で並べ, 良い方から config.candidates 個を子にする. mutex の中で呼ぶ.
+    // 残りの来そうなお邪魔ブロックはここで相殺して入れる (穴の列は raiseGuessedGarbage())
+    void expandNode(int n)
+    {
+        nodes[n].expanded = true;
+        if (!game.hasNext)
+            return;
+        const Node parent = nodes[n];
+        treeGenerator.generate(parent.board, spawnPiece(game.nextType));
+        const std::vector<Placement> &placements = treeGenerator.placements();
+        std::vector<std::pair<int, int>> ranked; /* (評価値, 置き方の番号) */
+        std::vector<Node> grown(placements.size());
+        for (int i = 0; i < (int)placements.size(); i++)
+        {
+            Node &child = grown[i];
+            child.piece = placements[i].piece;
+            int sent;
+            child.board = lock(parent.board, child.piece, sent);
+            int level = std::min(parent.carried - sent, STAGE_HEIGHT - 1);
+            if (level > 0)
+                raiseGuessedGarbage(child.board, level);
+            child.attack = parent.attack + sent;
+            child.carried = 0;
+            child.depth = 2;
+            ranked.push_back({score(child.board, sent), i});
+        }
+        std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+            return a.first > b.first;
+        });
+        nodes[n].first = (int)nodes.size();
+        for (int i = 0; i < (int)ranked.size() && i < config.candidates; i++)
+            nodes.push_back(grown[ranked[i].second]);
+        nodes[n].count = (int)nodes.size() - nodes[n].first;
+    }
+
+    // まだ試し打ちを始めてよいか. mutex の中で呼ぶ. 各子の1回目は締め切りを過ぎても試す
+    bool hasBudget()
+    {
+        if (rollouts < rootCount)
+            return true;
+        if (rollouts < config.rolloutBudget && std::chrono::steady_clock::now() < deadline && !(interrupt && interrupt()))
+            return true;
+        cutOff = rollouts < config.rolloutBudget;
+        return false;
+    }
+
+    // nodes[first] から count 個の兄弟の中から, UCB で次に試すノードを選ぶ. mutex の中で呼ぶ.
+    // 試している最中の回数は, 一番悪い結果が出たものとして数える
+    int select(int first, int count) const
+    {
+        int visitSum = 0;
+        for (int c = first; c < first + count; c++)
+        {
+            const Node &child = nodes[c];
+            if (child.visits + child.virtualVisits == 0)
+                return c; /* まだ試していない子から */
+            visitSum += child.visits + child.virtualVisits;
+        }
+
+        double logSum = std::log((double)visitSum);
+        int best = first;
+        double bestValue = 0;
+        for (int c = first; c < first + count; c++)
+        {
+            const Node &child = nodes[c];
+            // 結果がまだ1つも返っていない子は, 一番悪い結果と同じとみなす
+            double mean = child.visits == 0 ? lowest : meanOf(child);
+            double value = mean / config.valueScale + config.exploration * std::sqrt(logSum / (child.visits + child.virtualVisits));
+            if (c == first || value > bestValue)
+            {
+                bestValue = value;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    // 負けた試し打ちを lossValue(), 試している最中の分を一番悪い結果として混ぜた平均. visits が 1 以上の子だけ.
+    // 負けの値を生き残った結果から決めるので, 評価値の base をずらしても選ぶ手は変わらない
+    double meanOf(const Node &child) const
+    {
+        return (child.total + child.losses * lossValue() + child.virtualVisits * lowest) / (child.visits + child.virtualVisits);
+    }
+
+    // 負けた試し打ちの値. 生き残った試し打ちがまだなければ, 負け同士しか比べないので何でもよい
+    double lossValue() const
+    {
+        return hasLowest ? lowest - config.lossMargin : 0;
+    }
+
+    // 根から葉までノードを選んで試し打ちし, 通ったノードに結果を足すのを, 予算がなくなるまで繰り返す.
+    // 十分試した根の子は, 選ぶときに次のブロックの置き方まで伸ばす
+    void work(Worker &worker)
+    {
+        while (true)
+        {
+            int path[2], length = 0;
+            Node leaf;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!hasBudget())
+                    return;
+                int n = select(0, rootCount);
+                path[length++] = n;
+                if (!nodes[n].expanded && nodes[n].visits >= config.expandVisits)
+                    expandNode(n);
+                if (nodes[n].count > 0)
+                    path[length++] = select(nodes[n].first, nodes[n].count);
+                for (int i = 0; i < length; i++)
+                    nodes[path[i]].virtualVisits += config.virtualLoss;
+                leaf = nodes[path[length - 1]]; /* 他のスレッドが伸ばしている間も読めるよう, 写して外で使う */
+                rollouts++;
+            }
+
+            double value;
+            bool survived = rollout(leaf, worker, value);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int i = 0; i < length; i++)
+            {
+                Node &node = nodes[path[i]];
+                node.virtualVisits -= config.virtualLoss;
+                node.visits++;
+                if (survived)
+                    node.total += value;
+                else
+                    node.losses++;
+            }
+            if (survived)
+            {
+                lowest = hasLowest ? std::min(lowest, value) : value;
+                hasLowest = true;
+            }
+        }
+    }
+
+    // 葉の盤面から, 根の子の後に config.rolloutDepth 個になるまで1手の評価で置いてみて,
+    // 最後の盤面の評価値と根から送った行数を足したものを value に入れる. 途中で置けなくなったら false (負け)
+    bool rollout(const Node &leaf, Worker &worker, double &value) const
+    {
+        Bitboard board = leaf.board;
+        int attack = leaf.attack;
+        Bag bag = game.bag;
+        int type = leaf.depth == 1 && game.hasNext ? game.nextType : bag.next(worker.rng);
+
+        for (int d = 0; d < config.rolloutDepth - (leaf.depth - 1); d++)
+        {
+            dropPlacements(board, type, worker.drops);
+            if (worker.drops.empty())
+                return false;
+
+            int bestScore = SCORE_LOSS, bestAttack = 0;
+            Bitboard bestBoard;
+            for (const Piece &piece : worker.drops)
+            {
+                int sent;
+                Bitboard next = lock(board, piece, sent);
+                int value = score(next, sent);
+                if (value > bestScore)
+                {
+                    bestScore = value;
+                    bestBoard = next;
+                    bestAttack = sent;
+                }
+            }
+            board = bestBoard;
+            attack += bestAttack;
+            type = bag.next(worker.rng);
+
+            // 葉より後に来たお邪魔ブロックは, 最初の固定で相殺した残りを入れる. 穴の列はこの試し打ちの乱数で引く
+            int level = d == 0 ? std::min(leaf.carried - bestAttack, STAGE_HEIGHT - 1) : 0;
+            if (level > 0)
+            {
+                int spaces[STAGE_HEIGHT];
+                drawGarbageHoles(worker.rng, level, spaces);
+                board.raise(level, spaces);
+            }
+        }
+        value = score(board, attack);
+        return true;
+    }
+
+    const GameCore &game;
+    PlacementGenerator rootGenerator;
+    PlacementGenerator treeGenerator; /* 根の子を伸ばすとき. mutex の中でだけ使う */
+    std::vector<Node> nodes;
+    int rootCount = 0;
+    std::vector<Worker> workers;
+    std::mutex mutex;
+    double lowest = 0; /* これまでに生き残った試し打ちの一番悪い結果. virtual loss と負けの値に使う */
+    bool hasLowest = false;
+    int rollouts = 0;
+    bool cutOff = false;
+    std::chrono::steady_clock::time_point deadline;
+};
@@ -7,9 +7,11 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <random>
 #include <array>
+#include <algorithm>
 #include <queue>
 #include <deque>
 #include <stack>
@@ -17,6 +19,7 @@
 #include <unordered_set>
 
 #include "util.h"
+#include "piece.h"
 
 class ShaderProgram
 {
@@ -74,6 +77,8 @@ private:
     GLuint program;
 };
 
+class CubeBatch;
+
 class Entity
 {
 public:
@@ -81,7 +86,8 @@ public:
     ~Entity(){};
 
     virtual void update() = 0;
-    virtual void render(ShaderProgram *program, glm::mat4 &model, glm::mat4 &pers, glm::mat4 &view) = 0;
+    // 描画するキューブを batch に積む. 実際の描画は batch.draw() でまとめて行う
+    virtual void render(CubeBatch &batch, const glm::mat4 &model) = 0;
 
     glm::vec3 position{0, 0, 0};
     glm::quat rotation{1, 0, 0, 0};
@@ -90,68 +96,19 @@ public:
 private:
 };
 
+// 描画には CubeBatch を使う. Cube 自体は位置と色だけを持ち, GL のオブジェクトは作らない
 class Cube : public Entity
 {
 public:
-    Cube()
-    {
-        // 頂点バッファオブジェクト（VBO）の作成とデータの設定
-        GLuint vbo;
-        glGenBuffers(1, &this->vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-        // 頂点配列オブジェクト（VAO）の作成
-        glGenVertexArrays(1, &this->vao);
-        glBindVertexArray(this->vao);
-
-        // 頂点属性の設定
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void *)(sizeof(float) * 3));
-        glEnableVertexAttribArray(1);
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-        
-        checkGLError();
-    }
-    ~Cube()
-    {
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &ibo);
-
-        glDeleteVertexArrays(1, &vao);
-    }
-
     void update()
     {
     }
 
-    void render(ShaderProgram *program, glm::mat4 &model, glm::mat4 &pers, glm::mat4 &view)
-    {
-        // MVP行列
-        glm::mat4 thisModel = glm::translate(model, this->position);
-        thisModel = glm::mat4_cast(this->rotation) * thisModel;
-        thisModel = glm::scale(thisModel, glm::vec3(scale));
-        glUniformMatrix4fv(program->getLocation("MVP"), 1, GL_FALSE, glm::value_ptr(pers * view * thisModel));
-        glUniformMatrix4fv(program->getLocation("M"), 1, GL_FALSE, glm::value_ptr(thisModel));
-
-        // シェーダプログラムの使用開始
-        program->use();
+    void render(CubeBatch &batch, const glm::mat4 &model);
 
-        // 描画コール
-        glBindVertexArray(vao);
-        // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
-        // glDrawArrays(GL_TRIANGLES, 0, sizeof(vertices) / sizeof(GLfloat));
-        glDrawArrays(GL_TRIANGLES, 0, 32);
-        // glDrawElements(GL_TRIANGLES, sizeof(indices) / sizeof(GLuint), GL_UNSIGNED_INT, nullptr);
-    }
+    glm::vec3 color{0, 0, 0};
 
-private:
-    GLuint vao, vbo, ibo;
-
-    // 頂点データ
+    // 頂点データ. 1頂点に位置と法線の6つずつ
     static inline GLfloat vertices[] = {
         /*blue*/
         0.5f,
@@ -385,19 +342,161 @@ private:
         0.0f,
         -1.0f,
     };
+};
+
+enum MeshType
+{
+    MESH_CUBE,
+    MESH_TYPES,
+};
+
+// GPU に置いた頂点データ (位置と法線の6つずつ). MeshCache から受け取り, 最後の持ち主が手放すと消える
+class Mesh
+{
+public:
+    Mesh(const GLfloat *vertices, GLsizeiptr size) : vertexCount((int)(size / (6 * sizeof(GLfloat))))
+    {
+        glGenBuffers(1, &this->vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+        glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        checkGLError();
+    }
+    ~Mesh()
+    {
+        glDeleteBuffers(1, &vbo);
+    }
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    GLuint vbo;
+    int vertexCount;
+};
+
+// 形ごとに1つだけ Mesh を作って共有する. 誰かが持っている間は同じものを返し, 誰も持たなくなったら次に頼まれたとき作り直す
+class MeshCache
+{
+public:
+    static std::shared_ptr<Mesh> get(MeshType type)
+    {
+        static std::weak_ptr<Mesh> meshes[MESH_TYPES];
+        std::shared_ptr<Mesh> mesh = meshes[type].lock();
+        if (mesh)
+            return mesh;
+        switch (type)
+        {
+        case MESH_CUBE:
+        default:
+            mesh = std::make_shared<Mesh>(Cube::vertices, (GLsizeiptr)sizeof(Cube::vertices));
+            break;
+        }
+        meshes[type] = mesh;
+        return mesh;
+    }
+};
+
+// 同じ形のキューブをまとめて描く. 1フレーム分を add() で積んで upload() で送り, パスごとに draw() を1回呼ぶ.
+// 1つのキューブが1つのインスタンスで, 変換行列と色はインスタンス用のバッファから読む
+class CubeBatch
+{
+public:
+    CubeBatch() : mesh(MeshCache::get(MESH_CUBE))
+    {
+        glGenBuffers(1, &this->instanceVbo);
+
+        glGenVertexArrays(1, &this->vao);
+        glBindVertexArray(this->vao);
+
+        // 頂点ごとの属性 (位置, 法線). 頂点データは共有の Mesh のもの
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void *)(sizeof(float) * 3));
+        glEnableVertexAttribArray(1);
+
+        // インスタンスごとの属性. mat4 は vec4 の4つの属性 (3〜6) に分けて渡す. 色は 7
+        glBindBuffer(GL_ARRAY_BUFFER, this->instanceVbo);
+        for (int i = 0; i < 4; i++)
+        {
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)(sizeof(glm::vec4) * i));
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)sizeof(glm::mat4));
+        glEnableVertexAttribArray(7);
+        glVertexAttribDivisor(7, 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        checkGLError();
+    }
+    ~CubeBatch()
+    {
+        glDeleteBuffers(1, &instanceVbo);
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    void clear()
+    {
+        instances.clear();
+    }
+
+    void add(const glm::mat4 &model, const glm::vec3 &color)
+    {
+        instances.push_back({model, color});
+    }
+
+    // 積んだインスタンスを GPU に送る. 前のフレームの描画を待たないよう, 毎回バッファを取り直す
+    void upload()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        uploaded = (int)instances.size();
+    }
+
+    // 最後に upload() した分を, 今使っているシェーダプログラムで描く
+    void draw()
+    {
+        glBindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, mesh->vertexCount, uploaded);
+        glBindVertexArray(0);
+    }
+
+private:
+    struct Instance
+    {
+        glm::mat4 model;
+        glm::vec3 color;
+    };
 
+    std::shared_ptr<Mesh> mesh;
+    GLuint vao, instanceVbo;
+    std::vector<Instance> instances;
+    int uploaded = 0;
 };
 
+inline void Cube::render(CubeBatch &batch, const glm::mat4 &model)
+{
+    glm::mat4 thisModel = glm::translate(model, this->position);
+    thisModel = glm::mat4_cast(this->rotation) * thisModel;
+    thisModel = glm::scale(thisModel, glm::vec3(scale));
+    batch.add(thisModel, color);
+}
+
 class Tetrimino : public Entity
 {
 public:
     Tetrimino(int type) : type(type)
     {
-        for (auto pos : Tetrimino::positions[type])
+        const Cell *cells = pieceCells(type, 0);
+        for (int i = 0; i < 4; i++)
         {
             Cube *cube = new Cube();
-            cube->position = pos;
+            cube->position = glm::vec3(cells[i].x, cells[i].y, 0);
             cube->scale = 0.9f;
+            cube->color = colors[type];
             entities.push_back(cube);
         }
     }
@@ -415,88 +514,69 @@ public:
         rotLerp = 1;
     }
 
-    void unrotate()
+    void rotateLeft()
     {
-        rotnum = (rotnum - 1) % 4;
-        rotLerp = 0;
+        rotnum = (rotnum + 3) % 4;
+        rotLerp = -1;
     }
-    void update()
+
+    // 向きを rotnum に合わせる. 1つ隣の向きへの変化なら回転のアニメーションをつける
+    void setRotation(int to)
     {
-        if (rotLerp >= 0)
-            rotLerp -= 0.3f;
-        if (rotLerp <= 0)
+        if (to == rotnum)
+            return;
+        if (to == (rotnum + 1) % 4)
+            rotate();
+        else if (to == (rotnum + 3) % 4)
+            rotateLeft();
+        else
+        {
+            rotnum = to;
             rotLerp = 0;
+        }
+    }
+
+    // シミュレーションの1tickが始まる前の見た目を覚えておく. render() はここから今の状態へ補間する
+    void beginTick()
+    {
+        prevPosition = position;
+        prevAngle = rotnum - rotLerp;
+    }
+
+    void update()
+    {
+        if (rotLerp > 0)
+            rotLerp = std::max(rotLerp - 0.3f, 0.f);
+        if (rotLerp < 0)
+            rotLerp = std::min(rotLerp + 0.3f, 0.f);
         for (auto entity : entities)
         {
             entity->update();
         }
     }
 
-    void render(ShaderProgram *program, glm::mat4 &model, glm::mat4 &pers, glm::mat4 &view)
+    void render(CubeBatch &batch, const glm::mat4 &model)
     {
-        glm::mat4 thisModel = glm::translate(model, this->position);
-        thisModel = glm::rotate(thisModel, glm::radians((rotnum - rotLerp) * (-90.f)), glm::vec3(0, 0, 1));
+        // 前のtickとの間を alpha で補間する. 向きは 3 -> 0 のような回り込みを近い方へ回す
+        float angle = rotnum - rotLerp;
+        float diff = angle - prevAngle;
+        if (diff > 2)
+            diff -= 4;
+        if (diff < -2)
+            diff += 4;
+        glm::vec3 lerpPosition = glm::mix(prevPosition, this->position, alpha);
+        glm::mat4 thisModel = glm::translate(model, lerpPosition);
+        thisModel = glm::rotate(thisModel, glm::radians((prevAngle + diff * alpha) * (-90.f)), glm::vec3(0, 0, 1));
         for (auto entity : entities)
         {
-            glUniform3fv(program->getLocation("objectColor"), 1, glm::value_ptr(this->colors[this->type]));
-            entity->render(program, thisModel, pers, view);
+            entity->render(batch, thisModel);
         }
     }
 
     int type;
     int rotnum = 0;    /* 0, 1, 2, 3 */
-    float rotLerp = 0; /* to 100 */
-
-    inline const static std::vector<std::vector<glm::vec3>> positions = {
-        {
-            /*purple*/
-            glm::vec3(0, 0, 0),
-            glm::vec3(0, 1, 0),
-            glm::vec3(-1, 0, 0),
-            glm::vec3(1, 0, 0),
-        },
-        {
-            /*cyan*/
-            glm::vec3(0, 0, 0),
-            glm::vec3(-1, 0, 0),
-            glm::vec3(1, 0, 0),
-            glm::vec3(2, 0, 0),
-        },
-        {
-            /*green*/
-            glm::vec3(0, 0, 0),
-            glm::vec3(0, 1, 0),
-            glm::vec3(1, 0, 0),
-            glm::vec3(1, -1, 0),
-        },
-        {
-            /*red*/
-            glm::vec3(0, 0, 0),
-            glm::vec3(0, -1, 0),
-            glm::vec3(1, 0, 0),
-            glm::vec3(1, 1, 0),
-        },
-        {
-            /*orange*/
-            glm::vec3(0, 0, 0),
-            glm::vec3(0, 1, 0),
-            glm::vec3(0, -1, 0),
-            glm::vec3(-1, 1, 0),
-        },
-        {
-            /*blue*/
-            glm::vec3(0, 0, 0),
-            glm::vec3(0, 1, 0),
-            glm::vec3(0, -1, 0),
-            glm::vec3(1, 1, 0),
-        },
-        {
-            glm::vec3(0, 0, 0),
-            glm::vec3(0, 1, 0),
-            glm::vec3(1, 0, 0),
-            glm::vec3(1, 1, 0),
-        },
-    };
+    float rotLerp = 0; /* -1 to 1 */
+    float alpha = 1;   /* 前のtickから今のtickまでの描画の補間 0 to 1 */
 
     static inline const std::vector<glm::vec3> colors = {
         glm::vec3(.31f, 0, 0.31f), /*purple*/
@@ -511,6 +591,8 @@ public:
 
 private:
     std::vector<Entity *> entities;
+    glm::vec3 prevPosition{0, 0, 0};
+    float prevAngle = 0;
 };
 
 class Grid : public Entity
@@ -529,7 +611,7 @@ public:
     {
     }
 
-    void render(ShaderProgram *program, glm::mat4 &model, glm::mat4 &pers, glm::mat4 &view)
+    void render(CubeBatch &batch, const glm::mat4 &model)
     {
         for (int x = -1; x < 2; x++)
         {
@@ -538,8 +620,7 @@ public:
                 for (int z = -1; z < 2; z++)
                 {
                     glm::mat4 thisModel = glm::translate(model, this->position);
-                    glUniform3fv(program->getLocation("objectColor"), 1, glm::value_ptr(glm::vec3(0, 0, 0)));
-                    instance_cube->render(program, thisModel, pers, view);
+                    instance_cube->render(batch, thisModel);
                 }
             }
         }
@@ -555,6 +636,7 @@ public:
     Stage()
     {
         instance_cube = new Cube();
+        instance_cube->color = glm::vec3(0.7f, 0.7f, 0.7f);
     }
     ~Stage()
     {
@@ -565,16 +647,15 @@ public:
     {
     }
 
-    void render(ShaderProgram *program, glm::mat4 &model, glm::mat4 &pers, glm::mat4 &view)
+    void render(CubeBatch &batch, const glm::mat4 &model)
     {
-        glUniform3fv(program->getLocation("objectColor"), 1, glm::value_ptr(glm::vec3(0.7f, 0.7f, 0.7f)));
         for (int x = 0; x < 12; x++)
         {
             for (int y = 0; y < 21; y++)
             {
                 glm::mat4 thisModel = glm::translate(model, glm::vec3(x, y, -1));
                 thisModel = glm::mat4_cast(this->rotation) * thisModel;
-                instance_cube->render(program, thisModel, pers, view);
+                instance_cube->render(batch, thisModel);
             }
         }
 
@@ -582,21 +663,21 @@ public:
         {
             glm::mat4 thisModel = glm::translate(model, glm::vec3(0, y, 0));
             thisModel = glm::mat4_cast(this->rotation) * thisModel;
-            instance_cube->render(program, thisModel, pers, view);
+            instance_cube->render(batch, thisModel);
         }
 
         for (int y = 0; y < 21; y++)
         {
             glm::mat4 thisModel = glm::translate(model, glm::vec3(11, y, 0));
             thisModel = glm::mat4_cast(this->rotation) * thisModel;
-            instance_cube->render(program, thisModel, pers, view);
+            instance_cube->render(batch, thisModel);
         }
 
         for (int x = 0; x < 12; x++)
         {
             glm::mat4 thisModel = glm::translate(model, glm::vec3(x, 0, 0));
             thisModel = glm::mat4_cast(this->rotation) * thisModel;
-            instance_cube->render(program, thisModel, pers, view);
+            instance_cube->render(batch, thisModel);
         }
     }
 
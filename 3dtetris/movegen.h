@@ -0,0 +1,116 @@
+#pragma once
+
+// ブロックを置ける位置の列挙.
+// 本物のゲームと同じく「1tickに1回行動してから1マス落ちる」動きで (x, y, 回転) の状態を幅優先でたどり,
+// 埋まるセルが違う固定位置を1回ずつ出す (O を回しただけの位置のように同じセルを埋める向き違いは, 最初に見つけた1つだけ).
+// 行動列は持ち歩かず, 親へのリンクから選んだ位置の分だけ作り直す
+
+#include <algorithm>
+#include <bitset>
+#include <vector>
+
+#include "core.h"
+
+// 固定できる位置1つ
+struct Placement
+{
+    Piece piece;   /* 固定される位置 */
+    int node;      /* 最後の行動をする前の状態 */
+    Action action; /* 最後の行動. この後の落下で固定される */
+};
+
+class PlacementGenerator
+{
+public:
+    PlacementGenerator()
+    {
+        nodes.reserve(POSE_KEY_COUNT);
+        found.reserve(POSE_KEY_COUNT);
+    }
+
+    // board の上で start から置ける位置をすべて列挙して, その数を返す.
+    // 同じ盤面と同じ start なら, いつも同じ順番で出てくる
+    int generate(const Bitboard &board, const Piece &start)
+    {
+        visited.reset();
+        locked.reset();
+        nodes.clear();
+        found.clear();
+
+        if (board.overlaps(start.shape(), start.x, start.y))
+            return 0;
+        visited.set(poseKey(start));
+        nodes.push_back({start, -1, RL_ACTION_NONE});
+
+        for (int i = 0; i < (int)nodes.size(); i++)
+        {
+            for (Action action : ACTIONS)
+            {
+                Piece piece = nodes[i].piece;
+                if (applyAction(board, piece, action))
+                    continue; /* 巻き戻った. 何もしないのと同じ */
+
+                piece.y--;
+                if (!board.overlaps(piece.shape(), piece.x, piece.y))
+                {
+                    int key = poseKey(piece);
+                    if (!visited.test(key))
+                    {
+                        visited.set(key);
+                        nodes.push_back({piece, i, action});
+                    }
+                    continue;
+                }
+
+                // 落ちられないので, 行動した後の位置で固定される. 幅優先なので, 同じセルを埋める中で最初に見つかるのが一番短い行動列
+                piece.y++;
+                int key = cellKey(piece);
+                if (locked.test(key))
+                    continue;
+                locked.set(key);
+                found.push_back({piece, i, action});
+            }
+        }
+        return (int)found.size();
+    }
+
+    const std::vector<Placement> &placements() const
+    {
+        return found;
+    }
+
+    // たどった状態の数
+    int nodeCount() const
+    {
+        return (int)nodes.size();
+    }
+
+    // start から placement まで行く行動列 (先頭が最初の行動)
+    void path(const Placement &placement, std::vector<Action> &actions) const
+    {
+        actions.clear();
+        actions.push_back(placement.action);
+        for (int i = placement.node; nodes[i].parent >= 0; i = nodes[i].parent)
+            actions.push_back(nodes[i].action);
+        std::reverse(actions.begin(), actions.end());
+    }
+
+private:
+    struct Node
+    {
+        Piece piece;   /* この tick の行動の前の位置 */
+        int parent;    /* 1tick前の状態. 最初の状態は -1 */
+        Action action; /* 親からここへ来た行動 */
+    };
+
+    // 試す順番. 同じ状態に来られる行動が複数あれば, 前にある方が残る
+    static constexpr Action ACTIONS[] = {
+        RL_ACTION_NONE, RL_ACTION_LEFT, RL_ACTION_RIGHT, RL_ACTION_ROTATE_RIGHT,
+        RL_ACTION_ROTATE_LEFT, RL_ACTION_LEFT2, RL_ACTION_RIGHT2,
+    };
+
+    std::bitset<POSE_KEY_COUNT> visited; /* 行動の前の状態として通った位置 */
+    std::bitset<POSE_KEY_COUNT> locked;  /* 固定される位置として出したセル (cellKey) */
+    std::vector<Node> nodes;
+    std::vector<Placement> found;
+};
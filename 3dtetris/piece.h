@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+
+#include "board.h"
+
+constexpr int PIECE_TYPES = 7;
+constexpr int KICK_TESTS = 5;
+
+struct Cell
+{
+    int8_t x;
+    int8_t y;
+};
+
+// 回転0でのブロックの相対位置. 回転の中心は (0, 0)
+constexpr Cell PIECE_BASE_CELLS[PIECE_TYPES][4] = {
+    {{0, 0}, {0, 1}, {-1, 0}, {1, 0}},  /*purple*/
+    {{0, 0}, {-1, 0}, {1, 0}, {2, 0}},  /*cyan*/
+    {{0, 0}, {0, 1}, {1, 0}, {1, -1}},  /*green*/
+    {{0, 0}, {0, -1}, {1, 0}, {1, 1}},  /*red*/
+    {{0, 0}, {0, 1}, {0, -1}, {-1, 1}}, /*orange*/
+    {{0, 0}, {0, 1}, {0, -1}, {1, 1}},  /*blue*/
+    {{0, 0}, {0, 1}, {1, 0}, {1, 1}},   /*yellow*/
+};
+
+struct PieceTables
+{
+    Cell cells[PIECE_TYPES][4][4];
+    PieceShape shapes[PIECE_TYPES][4];
+    int8_t sameCells[PIECE_TYPES][4]; /* 同じ形になる一番小さい向き. O は全部 0, I・S・Z は 2 と 3 が 0 と 1 になる */
+};
+
+// 右回転 (x, y) -> (y, -x) を rotnum 回かけた位置とマスクをコンパイル時に作る
+constexpr PieceTables makePieceTables()
+{
+    PieceTables tables{};
+    for (int type = 0; type < PIECE_TYPES; type++)
+    {
+        for (int rot = 0; rot < 4; rot++)
+        {
+            Cell *cells = tables.cells[type][rot];
+            for (int i = 0; i < 4; i++)
+            {
+                int x = PIECE_BASE_CELLS[type][i].x;
+                int y = PIECE_BASE_CELLS[type][i].y;
+                for (int r = 0; r < rot; r++)
+                {
+                    int tmpx = x;
+                    x = y;
+                    y = -tmpx;
+                }
+                cells[i] = {(int8_t)x, (int8_t)y};
+            }
+
+            PieceShape &shape = tables.shapes[type][rot];
+            int minX = cells[0].x, minY = cells[0].y, maxY = cells[0].y;
+            for (int i = 1; i < 4; i++)
+            {
+                minX = cells[i].x < minX ? cells[i].x : minX;
+                minY = cells[i].y < minY ? cells[i].y : minY;
+                maxY = cells[i].y > maxY ? cells[i].y : maxY;
+            }
+            shape.minX = minX;
+            shape.minY = minY;
+            shape.height = maxY - minY + 1;
+            for (int i = 0; i < 4; i++)
+                shape.rows[cells[i].y - minY] |= (uint16_t)(1 << (cells[i].x - minX));
+
+            tables.sameCells[type][rot] = (int8_t)rot;
+            for (int other = rot - 1; other >= 0; other--)
+            {
+                const PieceShape &otherShape = tables.shapes[type][other];
+                bool same = otherShape.height == shape.height;
+                for (int i = 0; same && i < 4; i++)
+                    same = otherShape.rows[i] == shape.rows[i];
+                if (same)
+                    tables.sameCells[type][rot] = (int8_t)other;
+            }
+        }
+    }
+    return tables;
+}
+
+constexpr PieceTables PIECE_TABLES = makePieceTables();
+
+inline const PieceShape &pieceShape(int type, int rotnum)
+{
+    return PIECE_TABLES.shapes[type][rotnum];
+}
+
+inline const Cell *pieceCells(int type, int rotnum)
+{
+    return PIECE_TABLES.cells[type][rotnum];
+}
+
+// 向き rotnum と同じセルの形になる一番小さい向き. 位置をずらせば同じセルを埋められる
+inline int pieceSameCells(int type, int rotnum)
+{
+    return PIECE_TABLES.sameCells[type][rotnum];
+}
+
+static_assert(PIECE_TABLES.sameCells[6][3] == 0 && PIECE_TABLES.sameCells[1][2] == 0 && PIECE_TABLES.sameCells[1][3] == 1 &&
+                  PIECE_TABLES.sameCells[0][2] == 2,
+              "O, I, S, Z have fewer distinct rotations");
+
+// Super Rotation System の壁蹴り. [回転前の向き][0: 右回転, 1: 左回転][試す順]
+// https://tetrisch.github.io/main/srs.html
+typedef Cell KickTable[4][2][KICK_TESTS];
+
+constexpr KickTable SRS_KICKS_JLSTZ = {
+    {{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}},  /*0->R*/
+     {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},    /*0->L*/
+    {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}},      /*R->2*/
+     {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},     /*R->0*/
+    {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}},     /*2->L*/
+     {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}}, /*2->R*/
+    {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}},   /*L->0*/
+     {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}},  /*L->2*/
+};
+
+constexpr KickTable SRS_KICKS_I = {
+    {{{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}},  /*0->R*/
+     {{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}}}, /*0->L*/
+    {{{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}},  /*R->2*/
+     {{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}}}, /*R->0*/
+    {{{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}},  /*2->L*/
+     {{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}}}, /*2->R*/
+    {{{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}},  /*L->0*/
+     {{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}}}, /*L->2*/
+};
+
+// 黄色(O)は回してもずらさない
+constexpr KickTable SRS_KICKS_O = {};
+
+// type のブロックを向き rotnum から dir (+1: 右, -1: 左) に回すときに試すずらし量
+inline const Cell *srsKicks(int type, int rotnum, int dir)
+{
+    const KickTable &table = (type == 1) ? SRS_KICKS_I : (type == 6) ? SRS_KICKS_O : SRS_KICKS_JLSTZ;
+    return table[rotnum][dir > 0 ? 0 : 1];
+}
+
+inline int srsKickCount(int type)
+{
+    return (type == 6) ? 1 : KICK_TESTS;
+}
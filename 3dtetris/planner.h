@@ -0,0 +1,203 @@
+#pragma once
+
+// コンピュータの思考を裏のスレッドで走らせる.
+// 盤面とツモの複製を郵便受けで渡し, 選んだ置き方を別の郵便受けで受け取るので, 頼む側は待たない
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "ai.h"
+#include "mailbox.h"
+#include "mcts.h"
+
+class AsyncPlanner
+{
+public:
+    AsyncPlanner(ThreadPool *pool = nullptr) : cpu(snapshot), mcts(snapshot)
+    {
+        cpu.pool = pool;
+        mcts.pool = pool;
+        cpu.table = &table;
+        worker = std::thread([this] { run(); });
+    }
+    ~AsyncPlanner()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    // game の今の状態で考えてもらう. それより前に頼んだ計画は古くなり, 届いても捨てる.
+    // opponent を渡すと, 相手の盤面とブロックから来そうなお邪魔ブロックも見越して考える
+    void request(const GameCore &game, const GameCore *opponent = nullptr)
+    {
+        Request &slot = requests.writeSlot();
+        slot.generation = ++generation;
+        slot.game = game;
+        slot.opponent = opponent ? opponent->snapshot() : OpponentSnapshot();
+        latest.store(generation, std::memory_order_release);
+        requests.publish();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pending = true;
+        }
+        wake.notify_one();
+    }
+
+    // 最後に頼んだ状態に対する置き方が届いていれば, 固定される位置を target に入れて true
+    bool poll(Piece &target)
+    {
+        const Plan *plan = plans.take();
+        if (!plan || plan->generation != generation || !plan->found)
+            return false;
+        target = plan->target;
+        return true;
+    }
+
+    // 以下は最初の request() より前に決めておく
+    void setWeights(const EvalWeights &weights)
+    {
+        cpu.weights = weights;
+        mcts.weights = weights;
+        table.clear();
+    }
+
+    // ビームサーチの最初の答えを出した後, 残りの時間をビームの読み直しではなくモンテカルロ木探索に使う
+    void setMcts(const MctsConfig &config)
+    {
+        useMcts = true;
+        mcts.config = config;
+    }
+
+    bool verbose = false;       /* 選んだ置き方を標準出力に出す (裏のスレッドから) */
+    int thinkTimeUs = 100000;   /* 1つの依頼で考え続ける時間 (マイクロ秒). ブロックが落ちきるより十分短くする */
+    int maxBeamWidth = 64;      /* 考え直すたびに幅を倍にしていく上限 */
+
+private:
+    struct Request
+    {
+        uint32_t generation;
+        GameCore game;
+        OpponentSnapshot opponent;
+    };
+
+    struct Plan
+    {
+        uint32_t generation = 0;
+        bool found = false;
+        Piece target;
+    };
+
+    void run()
+    {
+        while (true)
+        {
+            // pending は sleepMutex の中で立てて下ろすので, 寝る直前に来た依頼も取りこぼさない
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [this] { return pending || stopping; });
+                if (stopping)
+                    return;
+                pending = false;
+            }
+            const Request *request = requests.take();
+            if (!request)
+                continue;
+
+            uint32_t requested = request->generation;
+            snapshot = request->game;
+            cpu.expectedAttack = estimateAttack(request->opponent, threatGenerator);
+            mcts.expectedAttack = cpu.expectedAttack;
+            think(requested);
+        }
+    }
+
+    // まず今の設定で答えを出し, 時間が残っていれば3手先まで, ビームの幅を倍にしながら読み直す.
+    // 読み終わるたびに計画を出すので, 頼む側はいつでもその時点で一番良い計画を持っている.
+    // 締め切りで途中までになった読み直しは, 前の答えより良いとは限らないので出さない
+    void think(uint32_t requested)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(thinkTimeUs);
+        SearchConfig base = cpu.config;
+        cpu.interrupt = [this, requested] { return requested != latest.load(std::memory_order_acquire); };
+        mcts.interrupt = cpu.interrupt;
+        for (int round = 0, width = base.beamWidth;; round++, width *= 2)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+            cpu.config.depth = round == 0 ? base.depth : std::max(base.depth, 3);
+            cpu.config.beamWidth = width;
+            cpu.config.timeBudgetUs = std::max(1, (int)left.count());
+
+            Plan &plan = plans.writeSlot();
+            plan.generation = requested;
+            plan.found = cpu.choosePlacement(plan.target);
+            bool complete = !cpu.wasCutOff();
+            if (verbose && plan.found)
+                std::cout << "planned " << plan.target.x << " " << plan.target.y << " " << plan.target.rotnum
+                          << " (depth " << cpu.config.depth << ", width " << width << ", " << cpu.lastNodeCount()
+                          << " nodes" << (complete ? "" : ", cut off") << ")" << std::endl;
+
+            // 考えている間に新しい依頼が来ていたら, この計画は出さない
+            if (requested != latest.load(std::memory_order_acquire))
+                break;
+            if (round == 0 || complete)
+                plans.publish();
+            if (useMcts && plan.found)
+            {
+                thinkMcts(requested, deadline);
+                break;
+            }
+            if (!plan.found || !complete || width >= maxBeamWidth)
+                break;
+        }
+        cpu.config = base;
+    }
+
+    // 締め切りまで試し打ちして, その答えで計画を出し直す. 試し打ちの回数の上限は config のまま
+    void thinkMcts(uint32_t requested, std::chrono::steady_clock::time_point deadline)
+    {
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0)
+            return;
+        int budget = mcts.config.timeBudgetUs;
+        mcts.config.timeBudgetUs = (int)left.count();
+
+        Plan &plan = plans.writeSlot();
+        plan.generation = requested;
+        plan.found = mcts.choosePlacement(plan.target);
+        if (verbose && plan.found)
+            std::cout << "planned " << plan.target.x << " " << plan.target.y << " " << plan.target.rotnum << " (mcts, "
+                      << mcts.lastRolloutCount() << " rollouts)" << std::endl;
+        if (plan.found && requested == latest.load(std::memory_order_acquire))
+            plans.publish();
+        mcts.config.timeBudgetUs = budget;
+    }
+
+    // 頼む側のスレッドだけが触る
+    uint32_t generation = 0;
+
+    // 裏のスレッドだけが触る
+    GameCore snapshot;
+    CpuPlayer cpu;
+    MctsPlayer mcts;
+    bool useMcts = false;
+    PlacementGenerator threatGenerator; /* estimateAttack() 用 */
+    TranspositionTable table; /* 続けて頼まれた同じ盤面 (お邪魔ブロックが来ただけなど) の読み直しはほぼここに当たる */
+
+    Mailbox<Request> requests;
+    Mailbox<Plan> plans;
+    std::atomic<uint32_t> latest{0};
+    std::mutex sleepMutex;
+    bool pending = false;  /* sleepMutex の中で読み書きする. まだ取っていない依頼がある */
+    bool stopping = false; /* sleepMutex の中で読み書きする */
+    std::condition_variable wake;
+    std::thread worker;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// 試合ごとに持つ小さな乱数生成器 (xoshiro128**). 状態は16バイトで, 種が同じなら同じ列を返す
+class Rng
+{
+public:
+    Rng() : Rng(std::random_device{}()) {}
+    explicit Rng(uint64_t seed) { this->seed(seed); }
+
+    // splitmix64 で種を広げて状態を作る
+    void seed(uint64_t seed)
+    {
+        for (int i = 0; i < 4; i += 2)
+        {
+            uint64_t z = splitmix64(seed);
+            state[i] = (uint32_t)z;
+            state[i + 1] = (uint32_t)(z >> 32);
+        }
+        if ((state[0] | state[1] | state[2] | state[3]) == 0)
+            state[0] = 1;
+    }
+
+    uint32_t next()
+    {
+        uint32_t result = rotl(state[1] * 5, 7) * 9;
+        uint32_t t = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 11);
+        return result;
+    }
+
+    // from 以上 to 以下の整数
+    int nextInt(int from, int to)
+    {
+        uint32_t range = (uint32_t)(to - from) + 1;
+        return from + (int)(((uint64_t)next() * range) >> 32);
+    }
+
+    // 種から別の種を作る. 1つの種から複数の生成器を分けるときに使う
+    static constexpr uint64_t splitmix64(uint64_t &x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    static uint32_t rotl(uint32_t x, int k)
+    {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    uint32_t state[4];
+};
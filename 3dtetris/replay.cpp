@@ -0,0 +1,75 @@
+// リプレイを再生する
+//   ./replay ファイル [tick]
+// tick を省くと最後まで何度も再生して速さを測る. tick を与えるとその時点の盤面を表示する
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "replay.h"
+
+static void printBoards(const GameCore games[2])
+{
+    for (int y = STAGE_HEIGHT - 1; y >= 0; y--)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            for (int x = 0; x < STAGE_WIDTH; x++)
+            {
+                bool falling = false;
+                const Piece &piece = games[i].piece;
+                const Cell *cells = pieceCells(piece.type, piece.rotnum);
+                for (int c = 0; c < 4; c++)
+                    falling |= (piece.x + cells[c].x == x && piece.y + cells[c].y == y);
+
+                int color = games[i].board.colors[y][x];
+                putchar(falling ? '@' : color == COLOR_WALL ? '#' : color == COLOR_EMPTY ? '.' : '0' + color);
+            }
+            printf("    ");
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s file [tick]\n", argv[0]);
+        return 1;
+    }
+
+    ReplayPlayer player;
+    if (!player.open(argv[1]))
+    {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    const ReplayHeader &header = player.getHeader();
+    printf("seed %llu, snapshot every %d ticks\n", (unsigned long long)header.seed, header.snapshotInterval);
+
+    if (argc > 2)
+    {
+        int tick = atoi(argv[2]);
+        if (!player.seek(tick))
+            printf("replay ends at tick %d\n", player.tick());
+        printf("tick %d\n", player.tick());
+        printBoards(player.games);
+        return 0;
+    }
+
+    int ticks = player.playToEnd();
+    printf("ticks %d, winner %d\n", ticks, player.winner());
+
+    const int repeat = 1000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; i++)
+    {
+        player.rewind();
+        player.playToEnd();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("played %d times in %.3f s (%.0f ticks/sec)\n", repeat, seconds, (double)ticks * repeat / seconds);
+
+    return 0;
+}
@@ -0,0 +1,425 @@
+#pragma once
+
+// 対戦の記録 (リプレイ). Match::play() が盤面に与えた行動とお邪魔ブロックを小さなバイナリで残し,
+// ウィンドウなしで最大速度で再生する.
+//
+// ファイルの形式 (数値はすべてリトルエンディアン)
+//   ヘッダ     ReplayHeader
+//   イベント列 varint(前のイベントからのtick差) varint(payload << 4 | kind << 2 | slot)
+//              kind が REPLAY_SNAPSHOT のときは続けて GameCore 2つ分の生データ
+//   索引       {uint32 tick, uint32 スナップショットの位置} * n, uint32 n
+//
+// slot は1tickの中での順番で, player * 2 + (0: 落下前の行動, 1: 落下の後)
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "core.h"
+
+static_assert(std::is_trivially_copyable<GameCore>::value, "GameCore is stored in replays as raw bytes");
+
+constexpr char REPLAY_MAGIC[4] = {'3', 'D', 'T', 'R'};
+constexpr uint16_t REPLAY_VERSION = 2;
+
+enum ReplayEventKind
+{
+    REPLAY_ACTION,   /* payload: Action */
+    REPLAY_GARBAGE,  /* payload: 送った行数. 相手の次の固定まで溜まる */
+    REPLAY_SNAPSHOT, /* payload: なし. 続けて両方の GameCore */
+    REPLAY_END,      /* payload: 勝者 + 1 (引き分けは0) */
+};
+
+struct ReplayHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t snapshotInterval; /* 何tickごとにスナップショットを入れるか */
+    uint32_t snapshotSize;     /* sizeof(GameCore). 作ったプログラムと合わなければ読めない */
+    uint32_t reserved;
+    uint64_t seed;
+};
+
+class ReplayWriter
+{
+public:
+    ReplayWriter(uint64_t seed, int snapshotInterval = 256)
+    {
+        ReplayHeader header{};
+        memcpy(header.magic, REPLAY_MAGIC, 4);
+        header.version = REPLAY_VERSION;
+        header.snapshotInterval = snapshotInterval;
+        header.snapshotSize = sizeof(GameCore);
+        header.seed = seed;
+        append(&header, sizeof(header));
+        this->snapshotInterval = snapshotInterval;
+    }
+
+    // tick が終わった時点の両方の盤面を残す. 間隔に合わないtickでは何もしない
+    void snapshot(int tick, const GameCore games[2])
+    {
+        if (snapshotInterval == 0 || tick % snapshotInterval != 0)
+            return;
+        index.push_back({(uint32_t)tick, (uint32_t)buffer.size()});
+        event(tick, 0, REPLAY_SNAPSHOT, 0);
+        append(&games[0], sizeof(GameCore));
+        append(&games[1], sizeof(GameCore));
+    }
+
+    void action(int tick, int player, Action action)
+    {
+        if (action != RL_ACTION_NONE)
+            event(tick, player * 2, REPLAY_ACTION, action);
+    }
+
+    // player が消した行で, 相手に level 行のお邪魔ブロックを送った
+    void garbage(int tick, int player, int level)
+    {
+        event(tick, player * 2 + 1, REPLAY_GARBAGE, level);
+    }
+
+    void end(int tick, int winner)
+    {
+        event(tick, 0, REPLAY_END, winner + 1);
+    }
+
+    bool save(const std::string &path)
+    {
+        std::vector<uint8_t> data = buffer;
+        for (const IndexEntry &entry : index)
+        {
+            appendTo(data, &entry.tick, 4);
+            appendTo(data, &entry.offset, 4);
+        }
+        uint32_t count = index.size();
+        appendTo(data, &count, 4);
+
+        FILE *file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    size_t size() const
+    {
+        return buffer.size();
+    }
+
+private:
+    struct IndexEntry
+    {
+        uint32_t tick;
+        uint32_t offset;
+    };
+
+    void event(int tick, int slot, ReplayEventKind kind, int payload)
+    {
+        varint(tick - lastTick);
+        varint(((uint32_t)payload << 4) | (kind << 2) | slot);
+        lastTick = tick;
+    }
+
+    void varint(uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            buffer.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back((uint8_t)value);
+    }
+
+    void append(const void *data, size_t size)
+    {
+        appendTo(buffer, data, size);
+    }
+
+    static void appendTo(std::vector<uint8_t> &out, const void *data, size_t size)
+    {
+        const uint8_t *bytes = (const uint8_t *)data;
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    std::vector<uint8_t> buffer;
+    std::vector<IndexEntry> index;
+    int snapshotInterval;
+    int lastTick = 0;
+};
+
+// リプレイファイルをメモリにマップして再生する. CPU の思考はせず, 記録された行動だけを GameCore に流す
+class ReplayPlayer
+{
+public:
+    ReplayPlayer() {}
+    ~ReplayPlayer()
+    {
+        close();
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(ReplayHeader) + 4))
+        {
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        data = (const uint8_t *)mapped;
+
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, REPLAY_MAGIC, 4) != 0 || header.version != REPLAY_VERSION ||
+            header.snapshotSize != sizeof(GameCore))
+        {
+            close();
+            return false;
+        }
+
+        uint32_t count;
+        memcpy(&count, data + size - 4, 4);
+        if ((size_t)count * 8 + 4 + sizeof(ReplayHeader) > size)
+        {
+            close();
+            return false;
+        }
+        indexStart = size - 4 - (size_t)count * 8;
+        indexCount = count;
+
+        return rewind();
+    }
+
+    void close()
+    {
+        if (data)
+            munmap((void *)data, size);
+        data = nullptr;
+        size = 0;
+    }
+
+    // 最初のスナップショット (tick 0) まで戻す
+    bool rewind()
+    {
+        if (indexCount == 0)
+            return false;
+        return restoreSnapshot(0);
+    }
+
+    // tick が終わった時点の盤面にする. 手前のスナップショットから再生し直す
+    bool seek(int tick)
+    {
+        if (tick < currentTick || (indexCount > 0 && (int)snapshotTick(nearestSnapshot(tick)) > currentTick))
+        {
+            if (!restoreSnapshot(nearestSnapshot(tick)))
+                return false;
+        }
+        while (currentTick < tick && step())
+        {
+        }
+        return currentTick == tick;
+    }
+
+    // 1tick進める. 記録の終わりに来たら false
+    bool step()
+    {
+        if (next.kind == REPLAY_END && next.tick <= currentTick)
+            finished = true;
+        if (finished)
+            return false;
+
+        int tick = currentTick + 1;
+        for (int i = 0; i < 2; i++)
+        {
+            // 落下前の行動
+            while (peekIs(tick, i * 2))
+            {
+                if (next.kind == REPLAY_ACTION)
+                    games[i].act((Action)next.payload);
+                advance();
+            }
+
+            int level = games[i].drop();
+
+            // 落下の後に相手へ送ったお邪魔ブロック
+            while (peekIs(tick, i * 2 + 1))
+            {
+                if (next.kind == REPLAY_GARBAGE)
+                    games[1 - i].attack(next.payload);
+                advance();
+            }
+            if (level >= 0)
+                games[i].spawn();
+        }
+        currentTick = tick;
+
+        // スナップショットは飛ばす
+        while (next.tick == currentTick && next.kind == REPLAY_SNAPSHOT)
+            advance();
+        return true;
+    }
+
+    // 最後まで再生して進めたtick数を返す
+    int playToEnd()
+    {
+        int start = currentTick;
+        while (step())
+        {
+        }
+        return currentTick - start;
+    }
+
+    const ReplayHeader &getHeader() const
+    {
+        return header;
+    }
+
+    int tick() const
+    {
+        return currentTick;
+    }
+
+    bool isFinished() const
+    {
+        return finished;
+    }
+
+    // 記録された勝者. 終わりのイベントまで読んでいないか引き分けなら -1
+    int winner() const
+    {
+        return recordedWinner;
+    }
+
+    GameCore games[2];
+
+private:
+    struct Event
+    {
+        int tick;
+        int slot;
+        int kind;
+        int payload;
+    };
+
+    uint32_t snapshotTick(int i) const
+    {
+        uint32_t tick;
+        memcpy(&tick, data + indexStart + (size_t)i * 8, 4);
+        return tick;
+    }
+
+    uint32_t snapshotOffset(int i) const
+    {
+        uint32_t offset;
+        memcpy(&offset, data + indexStart + (size_t)i * 8 + 4, 4);
+        return offset;
+    }
+
+    // tick 以前で一番近いスナップショット
+    int nearestSnapshot(int tick) const
+    {
+        int lo = 0, hi = indexCount - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi + 1) / 2;
+            if ((int)snapshotTick(mid) <= tick)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        return lo;
+    }
+
+    bool restoreSnapshot(int i)
+    {
+        pos = snapshotOffset(i);
+        finished = false;
+        recordedWinner = -1;
+        lastTick = 0;
+        if (!readEvent() || next.kind != REPLAY_SNAPSHOT || pos + 2 * sizeof(GameCore) > indexStart)
+            return false;
+        // スナップショットのtickは索引から取る (前のイベントとの差が分からないため)
+        lastTick = snapshotTick(i);
+        memcpy(&games[0], data + pos, sizeof(GameCore));
+        memcpy(&games[1], data + pos + sizeof(GameCore), sizeof(GameCore));
+        pos += 2 * sizeof(GameCore);
+        currentTick = lastTick;
+        advance();
+        return true;
+    }
+
+    bool peekIs(int tick, int slot) const
+    {
+        return next.kind != REPLAY_END && next.tick == tick && next.slot == slot;
+    }
+
+    // 次のイベントを読む. 記録が途中で切れていたら, そこで終わりとみなす
+    void advance()
+    {
+        if (!readEvent())
+        {
+            next = {0, 0, REPLAY_END, 0};
+            return;
+        }
+        if (next.kind == REPLAY_SNAPSHOT)
+            pos += 2 * sizeof(GameCore);
+        if (next.kind == REPLAY_END)
+            recordedWinner = next.payload - 1;
+    }
+
+    bool readEvent()
+    {
+        uint32_t delta, packed;
+        if (!readVarint(delta) || !readVarint(packed))
+            return false;
+        lastTick += delta;
+        next.tick = lastTick;
+        next.slot = packed & 3;
+        next.kind = (packed >> 2) & 3;
+        next.payload = packed >> 4;
+        return true;
+    }
+
+    bool readVarint(uint32_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            if (pos >= indexStart)
+                return false;
+            uint8_t byte = data[pos++];
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    size_t indexStart = 0;
+    int indexCount = 0;
+    ReplayHeader header{};
+
+    Event next{};
+    int lastTick = 0;
+    int currentTick = 0;
+    int recordedWinner = -1;
+    bool finished = false;
+};
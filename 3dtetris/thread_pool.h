@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ワークスティーリングのスレッドプール.
+// スレッドごとに仕事の列を持ち, 自分の列の後ろから取る. 空になったら他のスレッドの列の前から盗む
+class ThreadPool
+{
+public:
+    ThreadPool(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        queues = std::vector<WorkQueue>(threadCount);
+        for (int i = 0; i < threadCount; i++)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    int size() const
+    {
+        return (int)workers.size();
+    }
+
+    // 仕事を積む. 列は順番に選ぶ
+    void submit(std::function<void()> task)
+    {
+        int index = nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pending++;
+            queued++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues[index].mutex);
+            queues[index].tasks.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+    }
+
+    // 積んだ仕事がすべて終わるまで待つ
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        allDone.wait(lock, [this] { return pending == 0; });
+    }
+
+    // [0, count) をスレッド数で等分して fn(begin, end) を並べて走らせ, すべて終わるまで待つ.
+    // wait() と同じくプール全体を待つので, プールの仕事の中からは呼ばないこと
+    void parallelFor(int count, const std::function<void(int, int)> &fn)
+    {
+        int chunks = std::min(size(), count);
+        for (int i = 0; i < chunks; i++)
+        {
+            int begin = (int)((long long)count * i / chunks);
+            int end = (int)((long long)count * (i + 1) / chunks);
+            submit([&fn, begin, end] { fn(begin, end); });
+        }
+        wait();
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool popOwn(int index, std::function<void()> &task)
+    {
+        WorkQueue &queue = queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int thief, std::function<void()> &task)
+    {
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            WorkQueue &queue = queues[(thief + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(int index)
+    {
+        std::function<void()> task;
+        while (true)
+        {
+            if (popOwn(index, task) || steal(index, task))
+            {
+                queued--;
+                task();
+                task = nullptr;
+
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                if (--pending == 0)
+                    allDone.notify_all();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (stopping)
+                return;
+            wakeUp.wait(lock, [this] { return stopping || queued > 0; });
+        }
+    }
+
+    std::vector<WorkQueue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> nextQueue{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable allDone;
+    int pending = 0;               /* 終わっていない仕事の数 */
+    std::atomic<int> queued{0};    /* まだ誰も取り出していない仕事の数 */
+    bool stopping = false;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+// 置換表. 盤面の Zobrist ハッシュ (に種類ごとの塩を混ぜたキー) から評価値を引く.
+// 大きさは固定で, 読み書きにロックを取らない. 1つの項目はキーとデータの2語で, キーの方にはデータとの XOR を入れておき,
+// 別のスレッドと書き込みが混ざって食い違った項目は読むときにキーが合わないので捨てられる
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// キーの塩. 同じ盤面でも, 何を覚えたかで別の項目にする
+constexpr uint64_t TT_SALT_PLACED = 0x9E3779B97F4A7C15ull; /* 盤面に置いて行を消した後の評価値 */
+constexpr uint64_t TT_SALT_BEST[7] = {                       /* この盤面にこの種類を置いたときの最善の評価値 */
+    0xBF58476D1CE4E5B9ull, 0x94D049BB133111EBull, 0xD6E8FEB86659FD93ull, 0xA0761D6478BD642Full,
+    0xE7037ED1A0B428DBull, 0x8EBC6AF09C88C6E3ull, 0x589965CC75374CC3ull,
+};
+
+class TranspositionTable
+{
+public:
+    // 項目の数は 2^bits. 1項目16バイト
+    explicit TranspositionTable(int bits = 16) : mask((1ull << bits) - 1), entries(new Entry[1ull << bits])
+    {
+        clear();
+    }
+
+    // 他のスレッドが引いている間に呼ばないこと
+    void clear()
+    {
+        for (uint64_t i = 0; i <= mask; i++)
+        {
+            entries[i].check.store(~0ull, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64_t key, int &value) const
+    {
+        const Entry &entry = entries[key & mask];
+        uint64_t data = entry.data.load(std::memory_order_relaxed);
+        uint64_t check = entry.check.load(std::memory_order_relaxed);
+        if ((check ^ data) != key)
+            return false;
+        value = (int32_t)(uint32_t)data;
+        return true;
+    }
+
+    // 同じ場所の前の項目は上書きする
+    void store(uint64_t key, int value)
+    {
+        Entry &entry = entries[key & mask];
+        uint64_t data = (uint32_t)value;
+        entry.check.store(key ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> check; /* key ^ data */
+        std::atomic<uint64_t> data;
+    };
+
+    uint64_t mask;
+    std::unique_ptr<Entry[]> entries;
+};
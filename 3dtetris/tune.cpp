@@ -0,0 +1,197 @@
+// 評価の重みをウィンドウなしの自己対戦で調整する (交差エントロピー法)
+//   ./tune [世代数] [1世代の候補数] [1候補の種の数] [スレッド数] [書き出す重みのファイル] [途中経過のファイル]
+// 候補の重みを正規分布から引き, 基準の重み (classic) と席を入れ替えて対戦させる.
+// 勝ち越しの多い上位 1/4 の平均と広がりで分布を作り直し, 世代ごとに分布の平均を重みのファイルに書き出す.
+// 途中経過のファイルがあればそこから続ける. 同じ引数なら, スレッド数によらず同じ結果になる
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "match.h"
+#include "thread_pool.h"
+
+constexpr int TUNED = sizeof(WEIGHT_FIELDS) / sizeof(WEIGHT_FIELDS[0]) - 1; /* base 以外 */
+constexpr int MAX_PIECES = 300;      /* 1試合でどちらかがこれだけ置いたら引き分け */
+constexpr double MIN_SIGMA = 0.5;    /* 分布が1点に縮まないように足しておく広がり */
+
+struct Distribution
+{
+    int generation = 0;
+    double mean[TUNED];
+    double sigma[TUNED];
+};
+
+static EvalWeights toWeights(const double *values)
+{
+    EvalWeights weights = WEIGHTS_CLASSIC;
+    for (int i = 0; i < TUNED; i++)
+        weights.*WEIGHT_FIELDS[i + 1].field = std::max(0, (int)std::lround(values[i]));
+    return weights;
+}
+
+static bool saveCheckpoint(const std::string &path, const Distribution &dist)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+    fprintf(file, "generation %d\n", dist.generation);
+    for (int i = 0; i < TUNED; i++)
+        fprintf(file, "%s %.17g %.17g\n", WEIGHT_FIELDS[i + 1].name, dist.mean[i], dist.sigma[i]);
+    return fclose(file) == 0;
+}
+
+static bool loadCheckpoint(const std::string &path, Distribution &dist)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file)
+        return false;
+    bool ok = fscanf(file, "generation %d", &dist.generation) == 1;
+    char name[64];
+    for (int i = 0; ok && i < TUNED; i++)
+        ok = fscanf(file, "%63s %lf %lf", name, &dist.mean[i], &dist.sigma[i]) == 3;
+    fclose(file);
+    return ok;
+}
+
+// 標準正規分布 (Box-Muller)
+static double normal(Rng &rng)
+{
+    double u1 = (rng.next() + 0.5) / 4294967296.0;
+    double u2 = (rng.next() + 0.5) / 4294967296.0;
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+}
+
+// candidate が seat に座って reference と1試合. 勝ちを 1, 負けを -1 とし, 送ったお邪魔ブロックの差を少しだけ足す
+static double playOne(const EvalWeights &candidate, const EvalWeights &reference, uint32_t seed, int seat, int &pieces)
+{
+    SearchConfig config;
+    config.depth = 1;
+    Match match(seed);
+    match.setWeights(seat, candidate);
+    match.setWeights(1 - seat, reference);
+    match.setSearchConfig(0, config);
+    match.setSearchConfig(1, config);
+    MatchResult result = match.play(MAX_PIECES);
+
+    pieces = result.pieces[0] + result.pieces[1];
+    double score = 0.01 * (result.attacks[seat] - result.attacks[1 - seat]);
+    if (result.winner == seat)
+        score += 1;
+    else if (result.winner == 1 - seat)
+        score -= 1;
+    return score;
+}
+
+int main(int argc, char **argv)
+{
+    int generations = argc > 1 ? atoi(argv[1]) : 10;
+    int population = argc > 2 ? std::max(4, atoi(argv[2])) : 24;
+    int seedCount = argc > 3 ? std::max(1, atoi(argv[3])) : 4;
+    int threadCount = argc > 4 ? atoi(argv[4]) : 0;
+    std::string weightsPath = argc > 5 ? argv[5] : "weights.txt";
+    std::string checkpointPath = argc > 6 ? argv[6] : "tune.ckpt";
+
+    const EvalWeights reference = WEIGHTS_CLASSIC;
+    Distribution dist;
+    if (loadCheckpoint(checkpointPath, dist))
+    {
+        printf("resuming from %s at generation %d\n", checkpointPath.c_str(), dist.generation);
+    }
+    else
+    {
+        for (int i = 0; i < TUNED; i++)
+        {
+            dist.mean[i] = reference.*WEIGHT_FIELDS[i + 1].field;
+            dist.sigma[i] = std::max(3.0, dist.mean[i] * 0.5);
+        }
+    }
+
+    ThreadPool pool(threadCount);
+    int elites = std::max(2, population / 4);
+    int gamesPerCandidate = seedCount * 2;
+    std::vector<std::vector<double>> samples(population, std::vector<double>(TUNED));
+    std::vector<double> scores(population * gamesPerCandidate);
+    std::vector<int> pieces(population * gamesPerCandidate);
+
+    for (int end = dist.generation + generations; dist.generation < end; dist.generation++)
+    {
+        // 世代ごとに種を決め直すので, 途中から続けても同じ候補が引かれる
+        Rng rng(1000003ull * (dist.generation + 1));
+        for (auto &sample : samples)
+            for (int i = 0; i < TUNED; i++)
+                sample[i] = std::max(0.0, dist.mean[i] + dist.sigma[i] * normal(rng));
+
+        // 全候補が同じ種の組で対戦するので, 比べるときに種の運が揃う
+        uint32_t baseSeed = 7919u * (dist.generation + 1);
+        auto start = std::chrono::steady_clock::now();
+        for (int c = 0; c < population; c++)
+        {
+            for (int g = 0; g < gamesPerCandidate; g++)
+            {
+                pool.submit([&, c, g] {
+                    int slot = c * gamesPerCandidate + g;
+                    scores[slot] = playOne(toWeights(samples[c].data()), reference, baseSeed + g / 2, g % 2, pieces[slot]);
+                });
+            }
+        }
+        pool.wait();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> fitness(population, 0);
+        long long placed = 0;
+        for (int c = 0; c < population; c++)
+        {
+            for (int g = 0; g < gamesPerCandidate; g++)
+            {
+                fitness[c] += scores[c * gamesPerCandidate + g] / gamesPerCandidate;
+                placed += pieces[c * gamesPerCandidate + g];
+            }
+        }
+
+        std::vector<int> order(population);
+        for (int c = 0; c < population; c++)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return fitness[a] > fitness[b]; });
+
+        // 上位の平均と広がりを次の分布にする
+        double eliteFitness = 0;
+        for (int i = 0; i < TUNED; i++)
+        {
+            double sum = 0, squares = 0;
+            for (int e = 0; e < elites; e++)
+            {
+                double value = samples[order[e]][i];
+                sum += value;
+                squares += value * value;
+            }
+            double mean = sum / elites;
+            dist.mean[i] = mean;
+            dist.sigma[i] = std::sqrt(std::max(0.0, squares / elites - mean * mean)) + MIN_SIGMA;
+        }
+        for (int e = 0; e < elites; e++)
+            eliteFitness += fitness[order[e]] / elites;
+
+        int games = population * gamesPerCandidate;
+        printf("gen %3d  best %+.3f  elite %+.3f  %d games in %.2f s (%.1f games/s, %.0f pieces/s)\n",
+               dist.generation + 1, fitness[order[0]], eliteFitness, games, seconds, games / seconds, placed / seconds);
+        printf("        ");
+        for (int i = 0; i < TUNED; i++)
+            printf(" %s %.1f", WEIGHT_FIELDS[i + 1].name, dist.mean[i]);
+        printf("\n");
+        fflush(stdout);
+
+        Distribution next = dist;
+        next.generation++;
+        if (!saveWeights(weightsPath.c_str(), toWeights(dist.mean)) || !saveCheckpoint(checkpointPath, next))
+        {
+            fprintf(stderr, "failed to write %s or %s\n", weightsPath.c_str(), checkpointPath.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -3,7 +3,6 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
-#include <random>
 #include <iostream>
 
 int gKeyPressed[512];
@@ -15,11 +14,4 @@ void checkGLError()
     {
         std::cerr << "OpenGL Error: " << error << std::endl;
     }
-}
-
-int getRandomInt(int from, int to) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dis(from, to);
-    return dis(gen);
 }
\ No newline at end of file